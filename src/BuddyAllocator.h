@@ -4,6 +4,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <pthread.h>
 
 // =========================================================
 // = Memory layout example.
@@ -29,6 +30,42 @@
 // [ ChunkHeader_t ][ User space ]
 // |                |
 // Header ptr       User ptr
+//
+//
+// = split and merge
+//
+// A split carves the chunk down to the requested rank in one pass, the
+// upper half of every level is linked to its bucket on the way down.
+// free_bytes sums the free chunks. A chunk freed while free_bytes + 2^rank
+// equals the arena size is the last busy one: the free chunks are exactly
+// its buddy chain, so the buckets are emptied and the top chunk is pushed
+// without reading the buddy headers, which are usually cold by then.
+//
+//
+// = ownership
+//
+// An instance may be bound to an owner thread. Frees issued by any other
+// thread push the chunk onto a lock-free MPSC stack linked through
+// ChunkHeader_t::next. The owner drains the stack and coalesces the whole
+// batch on its next allocation. A queued chunk stays busy and is marked
+// with ChunkHeader_t::queued, set by a CAS before the push, so a second
+// free of the same chunk is ignored instead of pushed twice. The compactor
+// claims a chunk with the same field before moving it, a non-owner free
+// landing meanwhile is recorded there and completed by the compactor.
+//
+//
+// = memory pressure
+//
+// Pressure callbacks are invoked with the requested rank when an
+// allocation can not be satisfied, then the allocation is retried once.
+// They are also invoked when the free space at or above a rank drops
+// below the watermark set for that rank. The free space is calculated
+// from the per bucket free chunk counters, no chunks are visited:
+//
+// free_units(rank) = sum(free_nb[r] * 2^(r - rank)), r >= rank
+//
+// A watermark fires once when crossed and is re-armed by the first
+// allocation which finds the free space above it again.
 // =========================================================
 
 
@@ -44,12 +81,14 @@ struct ChunkHeader {
 	struct ChunkHeader* next;
 	Rank_t rank;
 	bool busy;
+	uint8_t relocator; // Zero for pinned chunks, see BuddyAllocatorCompact.h.
+	uint8_t queued; // __BUDDY_ALLOCATOR_QUEUED_*, see the ownership section.
 }; // TODO: No aligner is used since no memory alignment restrictions are specified.
 
 
 typedef struct ChunkHeader ChunkHdr_t;
-typedef ChunkHdr_t DListNode_t;
-#include "DList.h"
+typedef ChunkHdr_t CDListNode_t;
+#include "CDList.h"
 
 
 // ====================================
@@ -60,12 +99,54 @@ typedef ChunkHdr_t DListNode_t;
 
 #define __BUDDY_ALLOCATOR_RANK_MAX (Rank_t)(__BUDDY_ALLOCATOR_RANK_MIN + __BUDDY_ALLOCATOR_RANK_RANGE)
 #define __BUDDY_ALLOCATOR_CAPACITY_MAX (size_t)(SIZE_MAX - sizeof(ChunkHdr_t))
+#define __BUDDY_ALLOCATOR_PRESSURE_HANDLERS_MAX (size_t)(8)
+#define __BUDDY_ALLOCATOR_QUEUED_NONE (uint8_t)(0)
+#define __BUDDY_ALLOCATOR_QUEUED_REMOTE (uint8_t)(1) // On the remote free stack.
+#define __BUDDY_ALLOCATOR_QUEUED_MOVING (uint8_t)(2) // Being moved by the compactor.
+#define __BUDDY_ALLOCATOR_QUEUED_FREED (uint8_t)(3) // Freed by a non-owner thread while being moved.
+
+// Define BUDDY_ALLOCATOR_PREFETCH to prefetch the next header of the split
+// and merge chains, 2^rank bytes apart, while the current one is processed.
+// Off by default: the chain addresses derive from the chunk offset, not from
+// a loaded pointer, so an out-of-order core overlaps the misses by itself.
+// The call sites only use this macro, which expands to nothing otherwise.
+#ifdef BUDDY_ALLOCATOR_PREFETCH
+#define __BUDDY_ALLOCATOR_PREFETCH(ptr, rw) __builtin_prefetch((ptr), (rw))
+#else
+#define __BUDDY_ALLOCATOR_PREFETCH(ptr, rw) ((void)0)
+#endif
+
+#include "BuddyAllocatorTrace.h"
+
 
+/**
+ * Called under memory pressure. Expected to release some chunks.
+ * The node allocators of BuddyAllocatorNuma.h are locked while their handlers
+ * would run: register with buddy_numa_allocator_pressure_register() there.
+ * @param rank The rank which can not be satisfied or which free space dropped below the watermark.
+ */
+typedef void (*BuddyPressureCallback_t)(void* ctx, Rank_t rank);
 
 typedef struct {
-	DList_t buckets[__BUDDY_ALLOCATOR_RANK_RANGE];
+	BuddyPressureCallback_t callback;
+	void* ctx;
+} BuddyPressureHandler_t;
+
+typedef struct {
+	CDList_t buckets[__BUDDY_ALLOCATOR_RANK_RANGE + 1u];
+	size_t free_nb[__BUDDY_ALLOCATOR_RANK_RANGE + 1u];
+	size_t free_bytes;
 	void* raw_memory_ptr;
 	Rank_t raw_memory_rank;
+	bool owned;
+	pthread_t owner;
+	ChunkHdr_t* remote_free_head;
+	BuddyPressureHandler_t pressure_handlers[__BUDDY_ALLOCATOR_PRESSURE_HANDLERS_MAX];
+	size_t pressure_handlers_nb;
+	size_t watermarks[__BUDDY_ALLOCATOR_RANK_RANGE + 1u];
+	uint32_t watermarks_mask;
+	uint32_t watermarks_crossed;
+	bool in_pressure;
 } BuddyAllocator_t;
 
 
@@ -77,7 +158,7 @@ typedef struct {
  * @param ins The buddy allocator instance pointer. MUST NOT be null.
  * @return The maximum chunk size that can be allocated.
  */
-size_t buddy_allocator_capacity_max(const BuddyAllocator_t* const ins) {
+static inline size_t buddy_allocator_capacity_max(const BuddyAllocator_t* const ins) {
 	return (1ull << ins->raw_memory_rank) - sizeof(ChunkHdr_t);
 }
 
@@ -149,72 +230,243 @@ static inline ChunkHdr_t* __buddy_allocator_buddy(
 }
 
 
+/**
+ * Prefetches the buddy header the merge chain of the chunk reads at the rank.
+ * The address does not depend on any header, so it is known levels ahead.
+ */
+static inline void __buddy_allocator_prefetch_buddy(
+	const BuddyAllocator_t* const ins, const ChunkHdr_t* const chunk, const Rank_t rank
+                                                   ) {
+	if(rank < ins->raw_memory_rank) {
+		const uint8_t* const raw_mem_u8ptr = (const uint8_t* const)(ins->raw_memory_ptr);
+		size_t offset = (size_t)((const uint8_t*)chunk - raw_mem_u8ptr);
+		offset &= ~((1ull << rank) - 1u);
+		offset ^= 1ull << rank;
+		__BUDDY_ALLOCATOR_PREFETCH(raw_mem_u8ptr + offset, 0);
+	}
+}
+
+/**
+ * Links a free chunk to its bucket.
+ * The free bytes are accounted by the caller, once per operation.
+ */
+static inline void __buddy_allocator_bucket_push(BuddyAllocator_t* const ins, const BucketId_t bucket, ChunkHdr_t* const chunk) {
+	cdlist_push_front(ins->buckets + bucket, chunk);
+	ins->free_nb[bucket]++;
+}
+
+/**
+ * Unlinks a free chunk from its bucket.
+ * The free bytes are accounted by the caller, once per operation.
+ */
+static inline void __buddy_allocator_bucket_remove(BuddyAllocator_t* const ins, const BucketId_t bucket, ChunkHdr_t* const chunk) {
+	cdlist_remove(chunk);
+	ins->free_nb[bucket]--;
+}
+
 /**
  * Pushes a chunk to the free list.
+ * The buddies are merged upwards while they are free. If the chunk is the only
+ * busy one, the free chunks are exactly its buddy chain, one per bucket from
+ * its rank up: the buckets are emptied and the top chunk is pushed without
+ * visiting the chain.
+ * Otherwise, with BUDDY_ALLOCATOR_PREFETCH, the buddy a level ahead and the
+ * list neighbours of the merged buddy are prefetched on the way up.
  */
-static inline void __buddy_allocator_push_chunk(BuddyAllocator_t* const ins, ChunkHdr_t* const chunk) {
-	const BucketId_t bucket = chunk->rank - __BUDDY_ALLOCATOR_RANK_MIN;
-	ChunkHdr_t* const buddy = __buddy_allocator_buddy(ins, chunk);
-
-	if(buddy && !(buddy->busy) && buddy->rank == chunk->rank) {
-		ChunkHdr_t* const parent = chunk < buddy ? chunk : buddy;
-		dlist_remove(ins->buckets + bucket, buddy);
-		parent->rank++;
-		__buddy_allocator_push_chunk(ins, parent);
+static inline void __buddy_allocator_push_chunk(BuddyAllocator_t* const ins, ChunkHdr_t* chunk) {
+	ins->free_bytes += 1ull << chunk->rank;
+	if(ins->free_bytes == (1ull << ins->raw_memory_rank)) {
+		__BUDDY_TRACE_STEPS(ins->raw_memory_rank - chunk->rank);
+		for(Rank_t rank = chunk->rank; rank < ins->raw_memory_rank; ++rank) {
+			const BucketId_t bucket = rank - __BUDDY_ALLOCATOR_RANK_MIN;
+			cdlist_init(ins->buckets + bucket);
+			ins->free_nb[bucket] = 0;
+		}
+		chunk = (ChunkHdr_t*)(ins->raw_memory_ptr);
+		chunk->rank = ins->raw_memory_rank;
 	} else {
-		chunk->busy = false;
-		dlist_push_front(ins->buckets + bucket, chunk);
+		ChunkHdr_t* buddy = __buddy_allocator_buddy(ins, chunk);
+		__buddy_allocator_prefetch_buddy(ins, chunk, (Rank_t)(chunk->rank + 1u));
+		while(buddy && !(buddy->busy) && buddy->rank == chunk->rank) {
+			__BUDDY_TRACE_STEP();
+			__buddy_allocator_prefetch_buddy(ins, chunk, (Rank_t)(chunk->rank + 2u));
+			__BUDDY_ALLOCATOR_PREFETCH(buddy->prev, 1);
+			__BUDDY_ALLOCATOR_PREFETCH(buddy->next, 1);
+			__buddy_allocator_bucket_remove(ins, chunk->rank - __BUDDY_ALLOCATOR_RANK_MIN, buddy);
+			chunk = chunk < buddy ? chunk : buddy;
+			chunk->rank++;
+			buddy = __buddy_allocator_buddy(ins, chunk);
+		}
 	}
-
+	chunk->busy = false;
+	__buddy_allocator_bucket_push(ins, chunk->rank - __BUDDY_ALLOCATOR_RANK_MIN, chunk);
 }
 
 /**
  * Pops a chunk from the free list.
+ * A chunk of the lowest non-empty bucket at or above the rank is carved down in
+ * one pass: it keeps its lower half at every level and the upper halves are
+ * linked as free buddies, top to bottom. With BUDDY_ALLOCATOR_PREFETCH, the next
+ * buddy header and the bucket head it is linked before are prefetched for
+ * writing a level ahead.
  * May returns NULL.
  */
 static inline ChunkHdr_t* __buddy_allocator_pop_chunk(BuddyAllocator_t* const ins, const Rank_t rank) {
 	ChunkHdr_t* result = NULL;
 	if(rank >= __BUDDY_ALLOCATOR_RANK_MIN && rank <= ins->raw_memory_rank) {
 		const BucketId_t bucket = rank - __BUDDY_ALLOCATOR_RANK_MIN;
-		DList_t* const list = ins->buckets + bucket;
-
-		if(dlist_empty(list)) {
-
-			result = __buddy_allocator_pop_chunk(ins, (Rank_t) (rank + 1u));
-			if(result) {
-				result->rank = rank;
+		const BucketId_t top = ins->raw_memory_rank - __BUDDY_ALLOCATOR_RANK_MIN;
+		BucketId_t found = bucket;
+		while(found <= top && cdlist_empty(ins->buckets + found)) {
+			found++;
+		}
 
-				ChunkHdr_t* const buddy = __buddy_allocator_buddy(ins, result);
-				if(buddy) {
-					buddy->rank = rank;
-					buddy->busy = false;
-					dlist_push_front(ins->buckets + bucket, buddy);
+		if(found <= top) {
+			result = ins->buckets[found].sentinel.next;
+			__buddy_allocator_bucket_remove(ins, found, result);
+			ins->free_bytes -= 1ull << rank;
+
+			uint8_t* const result_u8ptr = (uint8_t*)result;
+			while(found > bucket) {
+				found--;
+				__BUDDY_TRACE_STEP();
+				const Rank_t half = (Rank_t)(found + __BUDDY_ALLOCATOR_RANK_MIN);
+				if(found > bucket) {
+					__BUDDY_ALLOCATOR_PREFETCH(result_u8ptr + (1ull << (half - 1u)), 1);
+					__BUDDY_ALLOCATOR_PREFETCH(ins->buckets[found - 1u].sentinel.next, 1);
 				}
-
+				ChunkHdr_t* const buddy = (ChunkHdr_t*)(result_u8ptr + (1ull << half));
+				buddy->rank = half;
+				buddy->busy = false;
+				__buddy_allocator_bucket_push(ins, found, buddy);
 			}
 
-		} else {
-			result = dlist_pop_front(list);
+			result->rank = rank;
 			result->busy = true;
+			result->relocator = 0;
+			result->queued = __BUDDY_ALLOCATOR_QUEUED_NONE;
 		}
 
 	}
 	return result;
 }
 
+/**
+ * Pushes a chunk freed by a non-owner thread to the remote free stack.
+ * Lock-free, may be called concurrently from any number of threads.
+ */
+static inline void __buddy_allocator_remote_push(BuddyAllocator_t* const ins, ChunkHdr_t* const chunk) {
+	ChunkHdr_t* head = __atomic_load_n(&ins->remote_free_head, __ATOMIC_RELAXED);
+	do {
+		chunk->next = head;
+	} while(!__atomic_compare_exchange_n(&ins->remote_free_head, &head, chunk, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+/**
+ * Detaches the whole remote free stack and pushes every chunk to the free lists.
+ * MUST BE called by the owner thread only.
+ */
+static inline void __buddy_allocator_remote_drain(BuddyAllocator_t* const ins) {
+	ChunkHdr_t* head = __atomic_exchange_n(&ins->remote_free_head, NULL, __ATOMIC_ACQUIRE);
+	while(head) {
+		ChunkHdr_t* const next = head->next;
+		__atomic_store_n(&head->queued, __BUDDY_ALLOCATOR_QUEUED_NONE, __ATOMIC_RELAXED);
+		__buddy_allocator_push_chunk(ins, head);
+		head = next;
+	}
+}
+
+/**
+ * Invokes all the pressure handlers.
+ * Nested invocations from within a handler are suppressed.
+ */
+static inline void __buddy_allocator_pressure(BuddyAllocator_t* const ins, const Rank_t rank) {
+	if(!(ins->in_pressure)) {
+		ins->in_pressure = true;
+		for(size_t idx = 0; idx < ins->pressure_handlers_nb; ++idx) {
+			ins->pressure_handlers[idx].callback(ins->pressure_handlers[idx].ctx, rank);
+		}
+		ins->in_pressure = false;
+	}
+}
+
+/**
+ * Checks the watermarks from the highest rank down, O(RANK_RANGE).
+ */
+static inline void __buddy_allocator_watermarks_check(BuddyAllocator_t* const ins) {
+	size_t units = 0;
+	Rank_t rank = ins->raw_memory_rank;
+	while(rank >= __BUDDY_ALLOCATOR_RANK_MIN) {
+		const BucketId_t bucket = rank - __BUDDY_ALLOCATOR_RANK_MIN;
+		units = (units << 1u) + ins->free_nb[bucket];
+
+		const uint32_t bit = 1u << bucket;
+		if(ins->watermarks_mask & bit) {
+			if(units < ins->watermarks[bucket]) {
+				if(!(ins->watermarks_crossed & bit)) {
+					ins->watermarks_crossed |= bit;
+					__buddy_allocator_pressure(ins, rank);
+				}
+			} else {
+				ins->watermarks_crossed &= ~bit;
+			}
+		}
+		rank--;
+	}
+}
+
+/**
+ * Allocates a chunk of the rank.
+ * The rank MUST BE RANK_MIN or higher, so it may be calculated at compile time by the caller.
+ * @param size The requested size, it is traced only.
+ */
+static inline void* __buddy_allocator_alloc_rank(BuddyAllocator_t* const ins, const Rank_t rank, const size_t size) {
+	void* result = NULL;
+	if(rank <= ins->raw_memory_rank) {
+		__BUDDY_TRACE_BEGIN(rank);
+		if(__atomic_load_n(&ins->remote_free_head, __ATOMIC_RELAXED)) {
+			__buddy_allocator_remote_drain(ins);
+		}
+		ChunkHdr_t* chunk = __buddy_allocator_pop_chunk(ins, rank);
+		if(chunk == NULL && ins->pressure_handlers_nb) {
+			__buddy_allocator_pressure(ins, rank);
+			chunk = __buddy_allocator_pop_chunk(ins, rank);
+		}
+		if(ins->watermarks_mask) {
+			__buddy_allocator_watermarks_check(ins);
+		}
+		result = __buddy_allocator_user_ptr(chunk);
+		__BUDDY_TRACE_END(chunk ? BUDDY_TRACE_OP_ALLOC : BUDDY_TRACE_OP_ALLOC_FAILED, size);
+	}
+	return result;
+}
+
+/**
+ * Splits a busy chunk down to the rank, the upper halves are pushed to the free lists.
+ * Their buddies are the busy chunk itself, so nothing is coalesced.
+ */
+static inline void __buddy_allocator_shrink_chunk(BuddyAllocator_t* const ins, ChunkHdr_t* const chunk, const Rank_t rank) {
+	while(chunk->rank > rank) {
+		chunk->rank--;
+		ChunkHdr_t* const buddy = __buddy_allocator_buddy(ins, chunk);
+		buddy->rank = chunk->rank;
+		__buddy_allocator_push_chunk(ins, buddy);
+	}
+}
+
 /**
  * @warning For debug purposes only.
  */
-void __buddy_allocator_dump_chunk(const BuddyAllocator_t* const ins, const ChunkHdr_t* chunk) {
+static inline void __buddy_allocator_dump_chunk(const BuddyAllocator_t* const ins, const ChunkHdr_t* chunk) {
 	const uint8_t* const raw_mem_u8ptr = (const uint8_t* const)(ins->raw_memory_ptr);
 	const uint8_t* head_u8ptr = (const uint8_t*)(chunk);
 	printf("[ Offset=%zu Rank=%u Busy=%d] -> ", head_u8ptr - raw_mem_u8ptr, chunk->rank, chunk->busy);
 }
 
-void __buddy_allocator_dump_bucket(const BuddyAllocator_t* const ins, const BucketId_t bucket) {
-	const DList_t* const list = ins->buckets + bucket;
-	const ChunkHdr_t* head = list->head;
-	while(head) {
+static inline void __buddy_allocator_dump_bucket(const BuddyAllocator_t* const ins, const BucketId_t bucket) {
+	const CDList_t* const list = ins->buckets + bucket;
+	const ChunkHdr_t* head = list->sentinel.next;
+	while(head != &list->sentinel) {
 		__buddy_allocator_dump_chunk(ins, head);
 		head = head->next;
 	}
@@ -225,7 +477,7 @@ void __buddy_allocator_dump_bucket(const BuddyAllocator_t* const ins, const Buck
  * @warning For debug purposes only.
  * @param ins The buddy allocator instance pointer. MUST NOT be null.
  */
-void __buddy_allocator_dump(const BuddyAllocator_t* const ins) {
+static inline void __buddy_allocator_dump(const BuddyAllocator_t* const ins) {
 	printf("==== Buddy Allocator instance ====\n");
 	printf("Struct ptr            : %p\n", ins);
 	printf("BuddyAllocator_t size : %zu\n", sizeof(*ins));
@@ -259,7 +511,7 @@ void __buddy_allocator_dump(const BuddyAllocator_t* const ins) {
 * @param memory_size Backing memory size. MUST BE a power of two value.
 * @return the new buddy allocator pointer or NULL in case of any errors.
 */
-BuddyAllocator_t* buddy_allocator_create(void* raw_memory, const size_t raw_memory_size) {
+static inline BuddyAllocator_t* buddy_allocator_create(void* raw_memory, const size_t raw_memory_size) {
 	BuddyAllocator_t* result = NULL;
 
 	// TODO: Are there any raw_memory alignment restrictions?
@@ -267,13 +519,13 @@ BuddyAllocator_t* buddy_allocator_create(void* raw_memory, const size_t raw_memo
 		const Rank_t rank = __buddy_allocator_rank(raw_memory_size);
 
 		if(rank >= __BUDDY_ALLOCATOR_RANK_MIN && rank <= __BUDDY_ALLOCATOR_RANK_MAX) {
-			result = malloc(sizeof(*result));
+			result = (BuddyAllocator_t*)malloc(sizeof(*result));
 
 			if(result) {
 				memset(result, 0, sizeof(*result));
 
-				for(Rank_t idx = 0; idx < __BUDDY_ALLOCATOR_RANK_RANGE; ++idx) {
-					dlist_init(result->buckets + idx);
+				for(Rank_t idx = 0; idx <= __BUDDY_ALLOCATOR_RANK_RANGE; ++idx) {
+					cdlist_init(result->buckets + idx);
 				}
 
 				result->raw_memory_ptr = raw_memory;
@@ -292,31 +544,114 @@ BuddyAllocator_t* buddy_allocator_create(void* raw_memory, const size_t raw_memo
 * Destroy a buddy allocator
 * @param ins The buddy allocator instance pointer. MUST NOT be null.
 */
-void buddy_allocator_destroy(BuddyAllocator_t* const ins) {
+static inline void buddy_allocator_destroy(BuddyAllocator_t* const ins) {
 	if(ins->raw_memory_ptr) {
 		ins->raw_memory_ptr = NULL;
 		free(ins);
 	}
 }
 
+/**
+* Bind the allocator to the calling thread.
+* From now on frees from any other thread are queued and coalesced by the owner
+* on its next allocation. Allocations MUST BE made by the owner thread only.
+* The binding is published with a release store, a thread which frees after
+* observing it sees the owner. Changing the owner MUST NOT race with frees.
+* @param ins The buddy allocator instance pointer. MUST NOT be null.
+*/
+static inline void buddy_allocator_set_owner(BuddyAllocator_t* const ins) {
+	ins->owner = pthread_self();
+	__atomic_store_n(&ins->owned, true, __ATOMIC_RELEASE);
+}
+
+/**
+* Unbind the allocator from its owner thread and coalesce all the queued chunks.
+* MUST BE called by the owner thread when no other thread frees concurrently.
+* @param ins The buddy allocator instance pointer. MUST NOT be null.
+*/
+static inline void buddy_allocator_reset_owner(BuddyAllocator_t* const ins) {
+	__buddy_allocator_remote_drain(ins);
+	__atomic_store_n(&ins->owned, false, __ATOMIC_RELEASE);
+}
+
+/**
+* Coalesce the chunks freed by non-owner threads without allocating.
+* MUST BE called by the owner thread only.
+* @param ins The buddy allocator instance pointer. MUST NOT be null.
+*/
+static inline void buddy_allocator_drain(BuddyAllocator_t* const ins) {
+	__buddy_allocator_remote_drain(ins);
+}
+
+/**
+* Register a memory pressure handler.
+* The handler is called from within buddy_allocator_alloc() and may free chunks of the same allocator.
+* @param ins The buddy allocator instance pointer. MUST NOT be null.
+* @param callback The handler. MUST NOT be null.
+* @param ctx The handler context.
+* @return zero on success or -1 if there are too many handlers.
+*/
+static inline int buddy_allocator_pressure_register(BuddyAllocator_t* const ins, BuddyPressureCallback_t callback, void* ctx) {
+	int result = -1;
+	if(ins->pressure_handlers_nb < __BUDDY_ALLOCATOR_PRESSURE_HANDLERS_MAX) {
+		ins->pressure_handlers[ins->pressure_handlers_nb].callback = callback;
+		ins->pressure_handlers[ins->pressure_handlers_nb].ctx = ctx;
+		ins->pressure_handlers_nb++;
+		result = 0;
+	}
+	return result;
+}
+
+/**
+* Unregister a memory pressure handler.
+* @param ins The buddy allocator instance pointer. MUST NOT be null.
+* @param callback The handler.
+* @param ctx The handler context.
+*/
+static inline void buddy_allocator_pressure_unregister(BuddyAllocator_t* const ins, BuddyPressureCallback_t callback, void* ctx) {
+	for(size_t idx = 0; idx < ins->pressure_handlers_nb; ++idx) {
+		if(ins->pressure_handlers[idx].callback == callback && ins->pressure_handlers[idx].ctx == ctx) {
+			ins->pressure_handlers_nb--;
+			ins->pressure_handlers[idx] = ins->pressure_handlers[ins->pressure_handlers_nb];
+			break;
+		}
+	}
+}
+
+/**
+* Set the free space watermark of a rank.
+* The pressure handlers are invoked with the rank when the free space at or above it drops below the watermark.
+* @param ins The buddy allocator instance pointer. MUST NOT be null.
+* @param rank The rank.
+* @param chunks_nb The minimal free space in chunks of the rank, zero disables the watermark.
+*/
+static inline void buddy_allocator_set_watermark(BuddyAllocator_t* const ins, const Rank_t rank, const size_t chunks_nb) {
+	if(rank >= __BUDDY_ALLOCATOR_RANK_MIN && rank <= ins->raw_memory_rank) {
+		const BucketId_t bucket = rank - __BUDDY_ALLOCATOR_RANK_MIN;
+		ins->watermarks[bucket] = chunks_nb;
+		ins->watermarks_crossed &= ~(1u << bucket);
+		if(chunks_nb) {
+			ins->watermarks_mask |= 1u << bucket;
+		} else {
+			ins->watermarks_mask &= ~(1u << bucket);
+		}
+	}
+}
+
 /**
 * Allocate memory
 * @param ins The buddy allocator instance pointer. MUST NOT be null.
 * @param size Size of memory to allocate
 * @return pointer to the newly allocated memory , or @a NULL if out of memory
 */
-void* buddy_allocator_alloc(BuddyAllocator_t* const ins, size_t size) {
+static inline void* buddy_allocator_alloc(BuddyAllocator_t* const ins, size_t size) {
 	void* result = NULL;
 	if(size < __BUDDY_ALLOCATOR_CAPACITY_MAX) {
-		size += sizeof(ChunkHdr_t);
-		Rank_t rank = __buddy_allocator_rank(size);
-		if(rank <= ins->raw_memory_rank) {
-			if(rank < __BUDDY_ALLOCATOR_RANK_MIN) {
-				rank = __BUDDY_ALLOCATOR_RANK_MIN;
-			}
-			ChunkHdr_t* const chunk = __buddy_allocator_pop_chunk(ins, rank);
-			result = __buddy_allocator_user_ptr(chunk);
+		Rank_t rank = __buddy_allocator_rank(size + sizeof(ChunkHdr_t));
+		if(rank < __BUDDY_ALLOCATOR_RANK_MIN) {
+			rank = __BUDDY_ALLOCATOR_RANK_MIN;
 		}
+		result = __buddy_allocator_alloc_rank(ins, rank, size);
 	}
 	return result;
 }
@@ -324,12 +659,66 @@ void* buddy_allocator_alloc(BuddyAllocator_t* const ins, size_t size) {
 /**
 * Deallocates a perviously allocated memory area.
 * If @a ptr is @a NULL , it simply returns
+* If the allocator is owned by another thread, the chunk is queued for the owner with a single CAS.
+* A chunk already queued is left alone, whoever frees it again. A chunk being moved by
+* the compactor, e.g. freed from a relocator, is marked freed, the compactor frees it once moved.
 * @param ins The buddy allocator instance pointer. MUST NOT be null.
 * @param raw_ptr The memory area to deallocate. MUST NOT be null.
 */
-void buddy_allocator_free(BuddyAllocator_t* const ins, void* const raw_ptr) {
+static inline void buddy_allocator_free(BuddyAllocator_t* const ins, void* const raw_ptr) {
 	ChunkHdr_t* const chunk = __buddy_allocator_header_ptr(raw_ptr);
-	if(chunk && chunk->busy) {
-		__buddy_allocator_push_chunk(ins, chunk);
+	uint8_t queued = __BUDDY_ALLOCATOR_QUEUED_MOVING;
+	if(chunk && chunk->busy
+	   && !__atomic_compare_exchange_n(&chunk->queued, &queued, __BUDDY_ALLOCATOR_QUEUED_FREED, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+	   && queued == __BUDDY_ALLOCATOR_QUEUED_NONE) {
+		__BUDDY_TRACE_BEGIN(chunk->rank);
+		if(__atomic_load_n(&ins->owned, __ATOMIC_ACQUIRE) && !pthread_equal(ins->owner, pthread_self())) {
+			if(__atomic_compare_exchange_n(&chunk->queued, &queued, __BUDDY_ALLOCATOR_QUEUED_REMOTE, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+				__buddy_allocator_remote_push(ins, chunk);
+			} else if(queued == __BUDDY_ALLOCATOR_QUEUED_MOVING) {
+				__atomic_compare_exchange_n(&chunk->queued, &queued, __BUDDY_ALLOCATOR_QUEUED_FREED, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+			}
+			__BUDDY_TRACE_END(BUDDY_TRACE_OP_FREE_REMOTE, 0);
+		} else {
+			__buddy_allocator_push_chunk(ins, chunk);
+			__BUDDY_TRACE_END(BUDDY_TRACE_OP_FREE, 0);
+		}
 	}
 }
+
+/**
+* Resize a perviously allocated memory area.
+* A chunk which keeps its rank or shrinks is resized in place, the released halves are freed.
+* A growing chunk is moved to a new chunk, the content is copied and the old chunk is freed.
+* The relocator id, see BuddyAllocatorCompact.h, is kept.
+* If @a raw_ptr is @a NULL , it simply allocates.
+* @param ins The buddy allocator instance pointer. MUST NOT be null.
+* @param raw_ptr The memory area to resize.
+* @param size The new size.
+* @return pointer to the resized memory, or @a NULL if out of memory, the memory area is left untouched then.
+*/
+static inline void* buddy_allocator_realloc(BuddyAllocator_t* const ins, void* const raw_ptr, const size_t size) {
+	void* result = NULL;
+	ChunkHdr_t* const chunk = __buddy_allocator_header_ptr(raw_ptr);
+	if(chunk == NULL) {
+		result = buddy_allocator_alloc(ins, size);
+	} else if(size < __BUDDY_ALLOCATOR_CAPACITY_MAX) {
+		Rank_t rank = __buddy_allocator_rank(size + sizeof(ChunkHdr_t));
+		if(rank < __BUDDY_ALLOCATOR_RANK_MIN) {
+			rank = __BUDDY_ALLOCATOR_RANK_MIN;
+		}
+
+		if(rank <= chunk->rank) {
+			__buddy_allocator_shrink_chunk(ins, chunk, rank);
+			result = raw_ptr;
+		} else {
+			result = __buddy_allocator_alloc_rank(ins, rank, size);
+			if(result) {
+				memcpy(result, raw_ptr, (1ull << chunk->rank) - sizeof(ChunkHdr_t));
+				__buddy_allocator_header_ptr(result)->relocator = chunk->relocator;
+				buddy_allocator_free(ins, raw_ptr);
+			}
+		}
+	}
+	return result;
+}
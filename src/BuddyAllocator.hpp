@@ -0,0 +1,298 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <memory_resource>
+#include <new>
+#include <stdexcept>
+
+#include "BuddyAllocator.h"
+
+// =========================================================
+// = C++17 layer.
+//
+// buddy::Arena          RAII owner of a buddy allocator and, optionally,
+//                       of its backing memory.
+// buddy::MemoryResource std::pmr::memory_resource over a buddy allocator.
+// buddy::Allocator<T>   STL allocator over a buddy allocator.
+//
+// = alignment
+//
+// A user pointer is the chunk start plus sizeof(ChunkHdr_t), so it is
+// aligned to alignof(ChunkHdr_t) as long as the backing memory is. Larger
+// alignments are served by over-allocating @a align + sizeof(void*) bytes,
+// rounding the pointer up and keeping the chunk user pointer right below
+// the returned one.
+//
+// = rank
+//
+// The rank of a request is a constexpr function of its size and alignment.
+// buddy::Allocator<T>::allocate(1), which node based containers call for
+// every node, uses the rank calculated at compile time.
+//
+// None of the classes is thread safe beyond the buddy allocator itself.
+// =========================================================
+
+namespace buddy {
+
+// ====================================
+// = Rank calculation.
+// ====================================
+
+constexpr std::size_t natural_alignment = alignof(ChunkHdr_t);
+
+/**
+ * Rank calculation. ceil(log2(capacity))
+ */
+constexpr Rank_t rank_of(std::size_t capacity) noexcept {
+	Rank_t result = 0;
+	if(capacity) {
+		capacity--;
+		while(capacity) {
+			result++;
+			capacity >>= 1;
+		}
+	}
+	return result;
+}
+
+/**
+ * @return the bytes to allocate for @a size bytes aligned to @a align.
+ */
+constexpr std::size_t padded_size(const std::size_t size, const std::size_t align) noexcept {
+	return align <= natural_alignment ? size : size + align + sizeof(void*);
+}
+
+/**
+ * @return the rank of the chunk serving @a size bytes aligned to @a align.
+ */
+constexpr Rank_t chunk_rank(const std::size_t size, const std::size_t align) noexcept {
+	const Rank_t rank = rank_of(padded_size(size, align) + sizeof(ChunkHdr_t));
+	return rank < __BUDDY_ALLOCATOR_RANK_MIN ? __BUDDY_ALLOCATOR_RANK_MIN : rank;
+}
+
+template<std::size_t Size, std::size_t Align = natural_alignment>
+inline constexpr Rank_t chunk_rank_v = chunk_rank(Size, Align);
+
+
+// ====================================
+// = Private methods.
+// ====================================
+namespace detail {
+
+/**
+ * Allocates a chunk of the known rank and aligns the pointer.
+ * @return NULL if out of memory.
+ */
+inline void* allocate_rank(
+	BuddyAllocator_t* const ba, const Rank_t rank, const std::size_t size, const std::size_t align
+                          ) noexcept {
+	void* result = __buddy_allocator_alloc_rank(ba, rank, size);
+	if(result && align > natural_alignment) {
+		const std::uintptr_t raw = reinterpret_cast<std::uintptr_t>(result);
+		const std::uintptr_t aligned = (raw + sizeof(void*) + align - 1u) & ~static_cast<std::uintptr_t>(align - 1u);
+		reinterpret_cast<void**>(aligned)[-1] = result;
+		result = reinterpret_cast<void*>(aligned);
+	}
+	return result;
+}
+
+/**
+ * @return NULL if out of memory or the size is too big.
+ */
+inline void* allocate(BuddyAllocator_t* const ba, const std::size_t size, const std::size_t align) noexcept {
+	void* result = nullptr;
+	if(size < __BUDDY_ALLOCATOR_CAPACITY_MAX - align - sizeof(void*)) {
+		result = allocate_rank(ba, chunk_rank(size, align), size, align);
+	}
+	return result;
+}
+
+inline void deallocate(BuddyAllocator_t* const ba, void* ptr, const std::size_t align) noexcept {
+	if(ptr && align > natural_alignment) {
+		ptr = static_cast<void**>(ptr)[-1];
+	}
+	buddy_allocator_free(ba, ptr);
+}
+
+} // namespace detail
+
+
+// ====================================
+// = PMR memory resource.
+// ====================================
+class MemoryResource : public std::pmr::memory_resource {
+public:
+	/**
+	 * @param ba The buddy allocator instance pointer. MUST NOT be null and MUST outlive the resource.
+	 */
+	explicit MemoryResource(BuddyAllocator_t* const ba) noexcept : ba_(ba) {}
+
+	BuddyAllocator_t* native() const noexcept {
+		return ba_;
+	}
+
+protected:
+	void* do_allocate(const std::size_t bytes, const std::size_t align) override {
+		void* const result = detail::allocate(ba_, bytes, align);
+		if(result == nullptr) {
+			throw std::bad_alloc();
+		}
+		return result;
+	}
+
+	void do_deallocate(void* const ptr, const std::size_t, const std::size_t align) override {
+		detail::deallocate(ba_, ptr, align);
+	}
+
+	bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+		const MemoryResource* const buddy = dynamic_cast<const MemoryResource*>(&other);
+		return buddy && buddy->ba_ == ba_;
+	}
+
+private:
+	BuddyAllocator_t* ba_;
+};
+
+
+// ====================================
+// = RAII arena.
+// ====================================
+class Arena {
+public:
+	/**
+	 * Create an arena over page aligned backing memory it owns.
+	 * @param size Backing memory size. MUST BE a power of two value in the supported range.
+	 */
+	explicit Arena(const std::size_t size) : Arena(allocate_memory(size), size, true) {}
+
+	/**
+	 * Create an arena over the caller's memory, which MUST outlive the arena.
+	 * @param memory Backing memory. MUST NOT be null.
+	 * @param size Backing memory size. MUST BE a power of two value in the supported range.
+	 */
+	Arena(void* const memory, const std::size_t size) : Arena(memory, size, false) {}
+
+	~Arena() {
+		buddy_allocator_destroy(ba_);
+		if(owned_) {
+			std::free(memory_);
+		}
+	}
+
+	Arena(const Arena&) = delete;
+	Arena& operator=(const Arena&) = delete;
+
+	/**
+	 * @return pointer to the newly allocated memory, or @a nullptr if out of memory.
+	 */
+	void* allocate(const std::size_t size) noexcept {
+		return buddy_allocator_alloc(ba_, size);
+	}
+
+	void deallocate(void* const ptr) noexcept {
+		buddy_allocator_free(ba_, ptr);
+	}
+
+	std::size_t capacity_max() const noexcept {
+		return buddy_allocator_capacity_max(ba_);
+	}
+
+	MemoryResource* resource() noexcept {
+		return &resource_;
+	}
+
+	BuddyAllocator_t* native() const noexcept {
+		return ba_;
+	}
+
+private:
+	static constexpr std::size_t page_size = 4096u;
+
+	static void* allocate_memory(const std::size_t size) {
+		if(!__buddy_allocator_is_po2(size) || size < page_size) {
+			throw std::invalid_argument("buddy::Arena size");
+		}
+		void* const result = std::aligned_alloc(page_size, size);
+		if(result == nullptr) {
+			throw std::bad_alloc();
+		}
+		return result;
+	}
+
+	static BuddyAllocator_t* create(void* const memory, const std::size_t size, const bool owned) {
+		BuddyAllocator_t* const result = buddy_allocator_create(memory, size);
+		if(result == nullptr) {
+			if(owned) {
+				std::free(memory);
+			}
+			throw std::invalid_argument("buddy::Arena memory");
+		}
+		return result;
+	}
+
+	Arena(void* const memory, const std::size_t size, const bool owned)
+		: memory_(memory), owned_(owned), ba_(create(memory, size, owned)), resource_(ba_) {}
+
+	void* memory_;
+	bool owned_;
+	BuddyAllocator_t* ba_;
+	MemoryResource resource_;
+};
+
+
+// ====================================
+// = STL allocator.
+// ====================================
+template<typename T>
+class Allocator {
+public:
+	using value_type = T;
+
+	/**
+	 * @param ba The buddy allocator instance pointer. MUST NOT be null and MUST outlive the allocator.
+	 */
+	explicit Allocator(BuddyAllocator_t* const ba) noexcept : ba_(ba) {}
+
+	explicit Allocator(Arena& arena) noexcept : ba_(arena.native()) {}
+
+	template<typename U>
+	Allocator(const Allocator<U>& other) noexcept : ba_(other.native()) {}
+
+	T* allocate(const std::size_t n) {
+		void* result = nullptr;
+		if(n == 1u) {
+			result = detail::allocate_rank(ba_, chunk_rank_v<sizeof(T), alignof(T)>, sizeof(T), alignof(T));
+		} else if(n <= SIZE_MAX / sizeof(T)) {
+			result = detail::allocate(ba_, n * sizeof(T), alignof(T));
+		}
+		if(result == nullptr) {
+			throw std::bad_alloc();
+		}
+		return static_cast<T*>(result);
+	}
+
+	void deallocate(T* const ptr, const std::size_t) noexcept {
+		detail::deallocate(ba_, ptr, alignof(T));
+	}
+
+	BuddyAllocator_t* native() const noexcept {
+		return ba_;
+	}
+
+private:
+	BuddyAllocator_t* ba_;
+};
+
+template<typename T, typename U>
+bool operator==(const Allocator<T>& lhs, const Allocator<U>& rhs) noexcept {
+	return lhs.native() == rhs.native();
+}
+
+template<typename T, typename U>
+bool operator!=(const Allocator<T>& lhs, const Allocator<U>& rhs) noexcept {
+	return !(lhs == rhs);
+}
+
+} // namespace buddy
@@ -0,0 +1,312 @@
+#pragma once
+
+#include "BuddyAllocatorWalk.h"
+
+// =========================================================
+// = Compaction.
+//
+// A few pinned low rank chunks may block the merges, so there are enough
+// free bytes but no free high rank chunk. The compactor moves the busy
+// chunks out of the way.
+//
+// Movable chunks are allocated with a relocator id, which is kept in the
+// chunk header. The relocator callback is told the old and the new user
+// pointers after the chunk content has been copied, it must update all
+// the references to the chunk.
+//
+// The compaction of a target rank:
+// 1. Every aligned 2^target region is costed by walking its chunks: the
+//    busy bytes to move. The regions holding a pinned chunk are skipped.
+// 2. The free chunks of the cheapest region are taken off the free lists,
+//    so nothing is allocated inside the region while it is evacuated.
+// 3. Every busy chunk of the region is copied to a new chunk of the same
+//    rank outside the region and its relocator is called.
+// 4. All the region chunks are pushed back and coalesce into a single
+//    chunk of the target rank.
+// If the moves run out of space, the region is released as it is.
+// =========================================================
+
+
+// ====================================
+// = Static configuration.
+// ====================================
+#define __BUDDY_COMPACTOR_RELOCATORS_MAX (size_t)(8)
+
+
+// ====================================
+// = Types definitions.
+// ====================================
+
+/**
+ * Called when a movable chunk has been moved.
+ * The chunk content is already copied to @a new_ptr, @a old_ptr is released after the call.
+ */
+typedef void (*BuddyRelocateCallback_t)(void* ctx, void* old_ptr, void* new_ptr);
+
+typedef struct {
+	BuddyRelocateCallback_t callback;
+	void* ctx;
+} BuddyRelocator_t;
+
+typedef struct {
+	size_t bytes_moved;
+	size_t chunks_moved;
+	Rank_t largest_free_rank_before; // Zero if there is no free chunk at all.
+	Rank_t largest_free_rank_after;
+} BuddyCompactReport_t;
+
+typedef struct {
+	BuddyAllocator_t* ba;
+	BuddyRelocator_t relocators[__BUDDY_COMPACTOR_RELOCATORS_MAX];
+	size_t relocators_nb;
+} BuddyCompactor_t;
+
+
+// ====================================
+// = Private methods.
+// ====================================
+
+static inline Rank_t __buddy_compactor_largest_free_rank(const BuddyAllocator_t* const ba) {
+	Rank_t result = 0;
+	Rank_t rank = ba->raw_memory_rank;
+	while(result == 0 && rank >= __BUDDY_ALLOCATOR_RANK_MIN) {
+		if(ba->free_nb[rank - __BUDDY_ALLOCATOR_RANK_MIN]) {
+			result = rank;
+		}
+		rank--;
+	}
+	return result;
+}
+
+static inline ChunkHdr_t* __buddy_compactor_chunk(const BuddyAllocator_t* const ba, const size_t offset) {
+	return (ChunkHdr_t*)((uint8_t*)(ba->raw_memory_ptr) + offset);
+}
+
+/**
+ * Calculates the cost of evacuating the region.
+ * @return false if the region can not be evacuated.
+ */
+static inline bool __buddy_compactor_region_cost(
+	const BuddyAllocator_t* const ba, const size_t region, const Rank_t target, size_t* const cost
+                                                ) {
+	bool result = (__buddy_allocator_walk_locate(ba, region) == region);
+	size_t busy_bytes = 0;
+
+	const size_t region_end = region + (1ull << target);
+	size_t offset = region;
+	while(result && offset < region_end) {
+		const ChunkHdr_t* const chunk = __buddy_compactor_chunk(ba, offset);
+		if(chunk->busy) {
+
+			// A chunk on the remote free stack is left for the owner drain, it pins the region.
+			result = (chunk->relocator != 0 && __atomic_load_n(&chunk->queued, __ATOMIC_ACQUIRE) == __BUDDY_ALLOCATOR_QUEUED_NONE);
+			busy_bytes += 1ull << chunk->rank;
+		}
+		offset += 1ull << chunk->rank;
+	}
+
+	*cost = busy_bytes;
+	return result;
+}
+
+/**
+ * Takes the free chunks of the region off the free lists and moves the busy ones out.
+ * Every chunk is claimed before it is moved, a chunk queued by a non-owner free
+ * meanwhile is left in place. If a non-owner frees it while it is moved, the new
+ * chunk is freed once the relocator has been called.
+ * Stops at the first chunk there is no room for.
+ */
+static inline void __buddy_compactor_evacuate(
+	BuddyCompactor_t* const ins, const size_t region, const Rank_t target, BuddyCompactReport_t* const report
+                                               ) {
+	BuddyAllocator_t* const ba = ins->ba;
+	const size_t region_end = region + (1ull << target);
+
+	// All the free chunks are reserved first, so no new chunk lands inside the region.
+	size_t offset = region;
+	while(offset < region_end) {
+		ChunkHdr_t* const chunk = __buddy_compactor_chunk(ba, offset);
+		if(!(chunk->busy)) {
+			const BucketId_t bucket = chunk->rank - __BUDDY_ALLOCATOR_RANK_MIN;
+			__buddy_allocator_bucket_remove(ba, bucket, chunk);
+			ba->free_bytes -= 1ull << chunk->rank;
+			chunk->busy = true;
+			chunk->relocator = 0;
+		}
+		offset += 1ull << chunk->rank;
+	}
+
+	offset = region;
+	while(offset < region_end) {
+		ChunkHdr_t* const chunk = __buddy_compactor_chunk(ba, offset);
+		uint8_t queued = __BUDDY_ALLOCATOR_QUEUED_NONE;
+		if(chunk->relocator
+		   && __atomic_compare_exchange_n(&chunk->queued, &queued, __BUDDY_ALLOCATOR_QUEUED_MOVING, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+			ChunkHdr_t* const moved = __buddy_allocator_pop_chunk(ba, chunk->rank);
+			if(moved == NULL) {
+				queued = __BUDDY_ALLOCATOR_QUEUED_MOVING;
+				if(!__atomic_compare_exchange_n(&chunk->queued, &queued, __BUDDY_ALLOCATOR_QUEUED_NONE, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+
+					// Freed meanwhile, it is released with the region.
+					chunk->relocator = 0;
+				}
+				break;
+			}
+
+			const BuddyRelocator_t* const relocator = ins->relocators + (chunk->relocator - 1u);
+			void* const old_ptr = __buddy_allocator_user_ptr(chunk);
+			void* const new_ptr = __buddy_allocator_user_ptr(moved);
+			memcpy(new_ptr, old_ptr, (1ull << chunk->rank) - sizeof(ChunkHdr_t));
+			moved->relocator = chunk->relocator;
+			chunk->relocator = 0;
+			relocator->callback(relocator->ctx, old_ptr, new_ptr);
+
+			if(__atomic_exchange_n(&chunk->queued, __BUDDY_ALLOCATOR_QUEUED_NONE, __ATOMIC_ACQ_REL) == __BUDDY_ALLOCATOR_QUEUED_FREED) {
+				__buddy_allocator_push_chunk(ba, moved);
+			}
+
+			report->bytes_moved += 1ull << chunk->rank;
+			report->chunks_moved++;
+		}
+		offset += 1ull << chunk->rank;
+	}
+}
+
+/**
+ * Pushes the reserved and the evacuated chunks back, they coalesce on the way.
+ * The chunks left unmoved keep their relocator.
+ */
+static inline void __buddy_compactor_release(BuddyCompactor_t* const ins, const size_t region, const Rank_t target) {
+	BuddyAllocator_t* const ba = ins->ba;
+	const size_t region_end = region + (1ull << target);
+	size_t offset = region;
+	while(offset < region_end) {
+		ChunkHdr_t* const chunk = __buddy_compactor_chunk(ba, offset);
+		const size_t size = 1ull << chunk->rank;
+
+		// The merges only touch the chunks behind, the ones ahead are still busy.
+		if(chunk->relocator == 0) {
+			__buddy_allocator_push_chunk(ba, chunk);
+		}
+		offset += size;
+	}
+}
+
+
+// ====================================
+// = Public methods.
+// ====================================
+
+/**
+* Create a compactor for the buddy allocator.
+* @param ba The buddy allocator instance pointer. MUST NOT be null.
+* @return the new compactor pointer or NULL in case of any errors.
+*/
+static inline BuddyCompactor_t* buddy_compactor_create(BuddyAllocator_t* const ba) {
+	BuddyCompactor_t* result = (BuddyCompactor_t*)malloc(sizeof(*result));
+	if(result) {
+		memset(result, 0, sizeof(*result));
+		result->ba = ba;
+	}
+	return result;
+}
+
+/**
+* Destroy the compactor.
+* All the movable chunks allocated through it MUST BE freed or pinned before.
+* @param ins The compactor instance pointer. MUST NOT be null.
+*/
+static inline void buddy_compactor_destroy(BuddyCompactor_t* const ins) {
+	free(ins);
+}
+
+/**
+* Register a relocator.
+* @param ins The compactor instance pointer. MUST NOT be null.
+* @param callback The relocation callback. MUST NOT be null.
+* @param ctx The callback context.
+* @return the relocator id or zero if there are too many relocators.
+*/
+static inline uint8_t buddy_compactor_register(BuddyCompactor_t* const ins, BuddyRelocateCallback_t callback, void* ctx) {
+	uint8_t result = 0;
+	if(ins->relocators_nb < __BUDDY_COMPACTOR_RELOCATORS_MAX) {
+		ins->relocators[ins->relocators_nb].callback = callback;
+		ins->relocators[ins->relocators_nb].ctx = ctx;
+		result = (uint8_t)(++(ins->relocators_nb));
+	}
+	return result;
+}
+
+/**
+* Allocate a movable chunk.
+* @param ins The compactor instance pointer. MUST NOT be null.
+* @param size Size of memory to allocate
+* @param relocator The relocator id returned by buddy_compactor_register().
+* @return pointer to the newly allocated memory , or @a NULL if out of memory
+*/
+static inline void* buddy_compactor_alloc(BuddyCompactor_t* const ins, const size_t size, const uint8_t relocator) {
+	void* result = NULL;
+	if(relocator && relocator <= ins->relocators_nb) {
+		result = buddy_allocator_alloc(ins->ba, size);
+		if(result) {
+			__buddy_allocator_header_ptr(result)->relocator = relocator;
+		}
+	}
+	return result;
+}
+
+/**
+* Pin a movable chunk, it is never moved afterwards.
+* @param raw_ptr A pointer returned by buddy_compactor_alloc(). MUST NOT be null.
+*/
+static inline void buddy_compactor_pin(void* const raw_ptr) {
+	__buddy_allocator_header_ptr(raw_ptr)->relocator = 0;
+}
+
+/**
+* Move the cheapest set of movable chunks blocking a free chunk of the target rank.
+* If the allocator is owned, only the owner thread may compact, it drains the chunks
+* freed by non-owner threads first. The call is refused for any other thread.
+* @param ins The compactor instance pointer. MUST NOT be null.
+* @param target The rank to make a free chunk of.
+* @param report The report. May be null.
+* @return true if there is a free chunk of the target rank or higher afterwards, false if refused.
+*/
+static inline bool buddy_compactor_compact(BuddyCompactor_t* const ins, const Rank_t target, BuddyCompactReport_t* report) {
+	BuddyAllocator_t* const ba = ins->ba;
+	BuddyCompactReport_t local_report;
+	if(report == NULL) {
+		report = &local_report;
+	}
+	memset(report, 0, sizeof(*report));
+
+	bool result = false;
+	if(!__atomic_load_n(&ba->owned, __ATOMIC_ACQUIRE) || pthread_equal(ba->owner, pthread_self())) {
+		__buddy_allocator_remote_drain(ba);
+		report->largest_free_rank_before = __buddy_compactor_largest_free_rank(ba);
+
+		if(target >= __BUDDY_ALLOCATOR_RANK_MIN && target <= ba->raw_memory_rank && report->largest_free_rank_before < target) {
+			bool found = false;
+			size_t best_region = 0;
+			size_t best_cost = SIZE_MAX;
+
+			for(size_t region = 0; region < (1ull << ba->raw_memory_rank); region += 1ull << target) {
+				size_t cost = 0;
+				if(__buddy_compactor_region_cost(ba, region, target, &cost) && cost < best_cost) {
+					found = true;
+					best_region = region;
+					best_cost = cost;
+				}
+			}
+
+			if(found) {
+				__buddy_compactor_evacuate(ins, best_region, target, report);
+				__buddy_compactor_release(ins, best_region, target);
+			}
+		}
+
+		report->largest_free_rank_after = __buddy_compactor_largest_free_rank(ba);
+		result = report->largest_free_rank_after >= target;
+	}
+	return result;
+}
@@ -0,0 +1,441 @@
+#pragma once
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "BuddyAllocatorShared.h"
+
+// =========================================================
+// = File backed persistent buddy allocator.
+//
+// The file is mapped as a whole, the shared buddy allocator is placed
+// right after a fixed size header page and a write-ahead log, so all the
+// links in the file are offsets and the file may be mapped at any address
+// on the next open. Opening a cleanly closed file costs O(1), no scan is
+// done. Files larger than 2^RANK_MAX bytes are accepted, the arena is
+// capped at that rank.
+//
+// A file is opened by one arena at a time, it is locked with flock(2)
+// until closed. The arena itself may be used by any number of threads,
+// every mutation and flush runs under the shared allocator mutex.
+//
+// = file layout
+//
+// | < 4096 bytes > | < ---- 64 KiB ---- > | < -------- file_size - headers -------- > |
+//
+// [ BuddyFileHeader_t ][ BuddyFileLogRecord_t ... ][ BuddySharedAllocator_t ][ pad ][ Raw memory (2^rank) ]
+//
+// = crash consistency
+//
+// Every split and merge appends an intent record to the log and syncs its
+// page before any chunk header is changed. The record holds the resulting
+// rank and busy state of every chunk the operation defines:
+//
+// - alloc: the chunk carved from a free chunk of rank_from down to rank,
+//   and its upper halves, one free chunk per rank in [rank, rank_from),
+// - free: the free chunk the merges end with.
+//
+// A checkpoint (flush) syncs the whole mapping and then increments the
+// header epoch, which voids all the records. On open, the records of the
+// current epoch are replayed in order: whatever subset of the chunk header
+// pages reached the disk, the replay rewrites every header the operations
+// defined, then the free lists are rebuilt from the headers and a
+// checkpoint is taken. That covers both a process crash and a power loss
+// or kernel crash, the data inside the chunks is not logged and is as
+// durable as the last checkpoint. A record is 16 bytes within a single
+// sector, a torn one can only be the last and is ignored, as its
+// operation has not started. A complete last record is redone, so an
+// allocation interrupted by the crash may be left busy and unreachable.
+//
+// The log is checkpointed when it is full.
+// =========================================================
+
+
+// ====================================
+// = Static configuration.
+// ====================================
+#define __BUDDY_FILE_MAGIC (uint64_t)(0x4255444459464c45ull) // "BUDDYFLE"
+#define __BUDDY_FILE_VERSION (uint32_t)(3)
+#define __BUDDY_FILE_HEADER_SIZE (size_t)(4096)
+#define __BUDDY_FILE_LOG_SIZE (size_t)(64u * 1024u)
+#define __BUDDY_FILE_META_SIZE (size_t)(__BUDDY_FILE_HEADER_SIZE + __BUDDY_FILE_LOG_SIZE)
+#define __BUDDY_FILE_LOG_CAPACITY (size_t)(__BUDDY_FILE_LOG_SIZE / sizeof(BuddyFileLogRecord_t))
+#define __BUDDY_FILE_PAGE_SIZE (size_t)(4096)
+
+
+// ====================================
+// = Types definitions.
+// ====================================
+typedef enum {
+	BUDDY_FILE_LOG_ALLOC = 1,
+	BUDDY_FILE_LOG_FREE = 2,
+} BuddyFileLogOp_t;
+
+typedef struct {
+	uint64_t magic;
+	uint32_t version;
+	uint32_t reserved;
+	uint64_t file_size;
+	uint64_t epoch; // Incremented by every checkpoint.
+	BuddyOffset_t root;
+} BuddyFileHeader_t;
+
+typedef struct {
+	BuddyOffset_t offset; // The chunk offset in the shared allocator.
+	uint32_t epoch; // The low half of the header epoch the record belongs to.
+	uint8_t op;
+	uint8_t rank;
+	uint8_t rank_from; // The rank of the split chunk, zero for frees.
+	uint8_t check;
+} BuddyFileLogRecord_t;
+
+typedef struct {
+	int fd;
+	uint8_t* map_ptr;
+	size_t map_size;
+	BuddyFileHeader_t* header;
+	BuddyFileLogRecord_t* log;
+	size_t log_nb;
+	BuddySharedAllocator_t* allocator;
+} BuddyFileArena_t;
+
+
+// ====================================
+// = Private methods.
+// ====================================
+
+static inline uint8_t __buddy_file_log_check(const BuddyFileLogRecord_t* const record) {
+	uint64_t value = record->offset ^ ((uint64_t)(record->epoch) << 24u);
+	value ^= (uint64_t)(record->op) | ((uint64_t)(record->rank) << 8u) | ((uint64_t)(record->rank_from) << 16u);
+	value ^= value >> 32u;
+	value ^= value >> 16u;
+	value ^= value >> 8u;
+	return (uint8_t)(value ^ 0xA5u);
+}
+
+/**
+ * Syncs the pages covering the area.
+ */
+static inline int __buddy_file_arena_sync(const void* const ptr, const size_t size) {
+	const uintptr_t first = (uintptr_t)ptr & ~(uintptr_t)(__BUDDY_FILE_PAGE_SIZE - 1u);
+	const uintptr_t end = (uintptr_t)ptr + size;
+	return msync((void*)first, end - first, MS_SYNC);
+}
+
+/**
+ * Syncs the whole mapping and voids the log records.
+ * MUST BE called with the allocator mutex held or with exclusive access.
+ * @return zero on success.
+ */
+static inline int __buddy_file_arena_checkpoint(BuddyFileArena_t* const ins) {
+	int result = msync(ins->map_ptr, ins->map_size, MS_SYNC);
+	if(result == 0) {
+		ins->header->epoch++;
+		result = __buddy_file_arena_sync(ins->header, sizeof(*(ins->header)));
+	}
+	if(result == 0) {
+		ins->log_nb = 0;
+	}
+	return result;
+}
+
+/**
+ * Appends an intent record and makes it durable, the log is checkpointed first if it is full.
+ * MUST BE called with the allocator mutex held, before the chunk headers are changed.
+ * @return zero on success, the operation MUST NOT be done otherwise.
+ */
+static inline int __buddy_file_arena_log(
+	BuddyFileArena_t* const ins, const BuddyFileLogOp_t op, const BuddyOffset_t offset, const Rank_t rank, const Rank_t rank_from
+                                        ) {
+	int result = 0;
+	if(ins->log_nb == __BUDDY_FILE_LOG_CAPACITY) {
+		result = __buddy_file_arena_checkpoint(ins);
+	}
+	if(result == 0) {
+		BuddyFileLogRecord_t* const record = ins->log + ins->log_nb;
+		record->offset = offset;
+		record->epoch = (uint32_t)(ins->header->epoch);
+		record->op = (uint8_t)op;
+		record->rank = rank;
+		record->rank_from = rank_from;
+		record->check = __buddy_file_log_check(record);
+		result = __buddy_file_arena_sync(record, sizeof(*record));
+		if(result == 0) {
+			ins->log_nb++;
+		}
+	}
+	return result;
+}
+
+/**
+ * Validates a record against the arena geometry.
+ */
+static inline bool __buddy_file_arena_record_valid(const BuddyFileArena_t* const ins, const BuddyFileLogRecord_t* const record) {
+	const BuddySharedAllocator_t* const ba = ins->allocator;
+	const Rank_t top = record->op == BUDDY_FILE_LOG_ALLOC ? record->rank_from : record->rank;
+	bool result = record->epoch == (uint32_t)(ins->header->epoch)
+	              && record->check == __buddy_file_log_check(record)
+	              && (record->op == BUDDY_FILE_LOG_ALLOC || record->op == BUDDY_FILE_LOG_FREE)
+	              && record->rank >= __BUDDY_ALLOCATOR_RANK_MIN && top >= record->rank && top <= ba->raw_memory_rank
+	              && record->offset >= ba->raw_memory_off;
+	if(result) {
+		const size_t offset = record->offset - ba->raw_memory_off;
+		result = offset < (1ull << ba->raw_memory_rank) && (offset & ((1ull << top) - 1u)) == 0;
+	}
+	return result;
+}
+
+/**
+ * Rewrites the chunk headers the records of the current epoch define.
+ * MUST BE called with exclusive access.
+ * @return the number of records replayed.
+ */
+static inline size_t __buddy_file_arena_replay(BuddyFileArena_t* const ins) {
+	size_t result = 0;
+	while(result < __BUDDY_FILE_LOG_CAPACITY && __buddy_file_arena_record_valid(ins, ins->log + result)) {
+		const BuddyFileLogRecord_t* const record = ins->log + result;
+		BuddySharedHdr_t* const chunk = __buddy_shared_allocator_hdr(ins->allocator, record->offset);
+		chunk->rank = record->rank;
+		chunk->busy = (record->op == BUDDY_FILE_LOG_ALLOC);
+		if(record->op == BUDDY_FILE_LOG_ALLOC) {
+			for(Rank_t half = record->rank; half < record->rank_from; ++half) {
+				BuddySharedHdr_t* const buddy = __buddy_shared_allocator_hdr(ins->allocator, record->offset + (1ull << half));
+				buddy->rank = half;
+				buddy->busy = false;
+			}
+		}
+		result++;
+	}
+	return result;
+}
+
+static inline void __buddy_file_arena_unmap(BuddyFileArena_t* const ins) {
+	if(ins->map_ptr) {
+		munmap(ins->map_ptr, ins->map_size);
+	}
+	if(ins->fd >= 0) {
+		close(ins->fd);
+	}
+	free(ins);
+}
+
+/**
+ * Formats a new file.
+ * @return zero on success.
+ */
+static inline int __buddy_file_arena_format(BuddyFileArena_t* const ins) {
+	int result = -1;
+	ins->allocator = buddy_shared_allocator_create(
+		ins->map_ptr + __BUDDY_FILE_META_SIZE, ins->map_size - __BUDDY_FILE_META_SIZE);
+
+	if(ins->allocator) {
+		ins->header->version = __BUDDY_FILE_VERSION;
+		ins->header->file_size = ins->map_size;
+		ins->header->epoch = 1u;
+		ins->header->root = __BUDDY_SHARED_ALLOCATOR_NIL;
+
+		// The magic goes last, a file interrupted while formatting is never taken for a valid one.
+		if(msync(ins->map_ptr, ins->map_size, MS_SYNC) == 0) {
+			ins->header->magic = __BUDDY_FILE_MAGIC;
+			result = __buddy_file_arena_sync(ins->header, sizeof(*(ins->header)));
+		}
+	}
+	return result;
+}
+
+/**
+ * Attaches to a previously formatted file, replays the log if needed.
+ * @return zero on success.
+ */
+static inline int __buddy_file_arena_load(BuddyFileArena_t* const ins) {
+	int result = -1;
+	if(ins->header->magic == __BUDDY_FILE_MAGIC
+	   && ins->header->version == __BUDDY_FILE_VERSION
+	   && ins->header->file_size == ins->map_size) {
+
+		ins->allocator = buddy_shared_allocator_attach(ins->map_ptr + __BUDDY_FILE_META_SIZE);
+		if(ins->allocator) {
+
+			// Whoever held the mutex when the file was closed is gone.
+			result = __buddy_shared_allocator_mutex_init(ins->allocator);
+			if(result == 0 && __buddy_file_arena_replay(ins)) {
+				result = buddy_shared_allocator_recover(ins->allocator);
+				if(result == 0) {
+					result = __buddy_file_arena_checkpoint(ins);
+				}
+			}
+		}
+	}
+	return result;
+}
+
+
+// ====================================
+// = Public methods.
+// ====================================
+
+/**
+* Open a persistent buddy allocator backed by a file. The file is created if it does not exist.
+* The open fails if the file is already opened by another arena, in this or any other process.
+* @param path The file path. MUST NOT be null.
+* @param file_size The size of a new file, ignored when the file exists.
+* The biggest power of two area, up to 2^RANK_MAX bytes, which fits the file after the headers is managed.
+* @return the new arena pointer or NULL in case of any errors.
+*/
+static inline BuddyFileArena_t* buddy_allocator_open_file(const char* const path, const size_t file_size) {
+	BuddyFileArena_t* result = (BuddyFileArena_t*)malloc(sizeof(*result));
+
+	if(result) {
+		memset(result, 0, sizeof(*result));
+		result->fd = open(path, O_RDWR | O_CREAT, 0644);
+
+		bool success = (result->fd >= 0);
+		bool created = false;
+		struct stat st;
+
+		// The load re-initializes the allocator mutex, nobody else may be using the file.
+		if(success) {
+			success = (flock(result->fd, LOCK_EX | LOCK_NB) == 0);
+		}
+		if(success) {
+			success = (fstat(result->fd, &st) == 0);
+		}
+		if(success && st.st_size == 0) {
+			success = (file_size > __BUDDY_FILE_META_SIZE && ftruncate(result->fd, (off_t)file_size) == 0);
+			st.st_size = (off_t)file_size;
+			created = true;
+		}
+		if(success) {
+			success = ((size_t)st.st_size > __BUDDY_FILE_META_SIZE);
+		}
+		if(success) {
+			result->map_size = (size_t)st.st_size;
+			void* const map = mmap(NULL, result->map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_NORESERVE, result->fd, 0);
+			success = (map != MAP_FAILED);
+			if(success) {
+				result->map_ptr = (uint8_t*)map;
+				result->header = (BuddyFileHeader_t*)map;
+				result->log = (BuddyFileLogRecord_t*)(result->map_ptr + __BUDDY_FILE_HEADER_SIZE);
+			}
+		}
+		if(success) {
+			success = (created ? __buddy_file_arena_format(result) : __buddy_file_arena_load(result)) == 0;
+		}
+
+		if(!success) {
+			__buddy_file_arena_unmap(result);
+			result = NULL;
+		}
+	}
+	return result;
+}
+
+/**
+* Flush point. Syncs the whole file and empties the log.
+* @param ins The arena instance pointer. MUST NOT be null.
+* @return zero on success.
+*/
+static inline int buddy_file_arena_flush(BuddyFileArena_t* const ins) {
+	int result = __buddy_shared_allocator_lock(ins->allocator);
+	if(result == 0) {
+		result = __buddy_file_arena_checkpoint(ins);
+		__buddy_shared_allocator_unlock(ins->allocator);
+	}
+	return result;
+}
+
+/**
+* Flush and close the arena, the file lock is released.
+* @param ins The arena instance pointer. MUST NOT be null.
+* @return zero if the final flush succeeded.
+*/
+static inline int buddy_file_arena_close(BuddyFileArena_t* const ins) {
+	const int result = buddy_file_arena_flush(ins);
+	__buddy_file_arena_unmap(ins);
+	return result;
+}
+
+/**
+* Allocate memory in the file.
+* One intent record is synced per call.
+* @param ins The arena instance pointer. MUST NOT be null.
+* @param size Size of memory to allocate
+* @return pointer to the newly allocated memory , or @a NULL if out of memory or if the log can not be written
+*/
+static inline void* buddy_file_arena_alloc(BuddyFileArena_t* const ins, const size_t size) {
+	void* result = NULL;
+	BuddySharedAllocator_t* const ba = ins->allocator;
+	const Rank_t rank = __buddy_shared_allocator_size_rank(ba, size);
+	if(rank && __buddy_shared_allocator_lock(ba) == 0) {
+
+		// The chunk the allocator splits is the head of the lowest non-empty bucket.
+		Rank_t rank_from = rank;
+		while(rank_from <= ba->raw_memory_rank && ba->buckets[rank_from - __BUDDY_ALLOCATOR_RANK_MIN] == __BUDDY_SHARED_ALLOCATOR_NIL) {
+			rank_from++;
+		}
+		if(rank_from <= ba->raw_memory_rank) {
+			const BuddyOffset_t offset = ba->buckets[rank_from - __BUDDY_ALLOCATOR_RANK_MIN];
+			if(__buddy_file_arena_log(ins, BUDDY_FILE_LOG_ALLOC, offset, rank, rank_from) == 0) {
+				result = __buddy_shared_allocator_alloc_locked(ba, rank);
+			}
+		}
+		__buddy_shared_allocator_unlock(ba);
+	}
+	return result;
+}
+
+/**
+* Deallocates a perviously allocated memory area.
+* If @a ptr is @a NULL , it simply returns
+* One intent record is synced per call, the area is left allocated if it can not be written.
+* @param ins The arena instance pointer. MUST NOT be null.
+* @param raw_ptr The memory area to deallocate.
+*/
+static inline void buddy_file_arena_free(BuddyFileArena_t* const ins, void* const raw_ptr) {
+	BuddySharedAllocator_t* const ba = ins->allocator;
+	if(raw_ptr && __buddy_shared_allocator_lock(ba) == 0) {
+		const BuddySharedHdr_t* const chunk = (const BuddySharedHdr_t*)raw_ptr - 1;
+		if(chunk->busy) {
+
+			// The merges go up while the buddy is a free chunk of the same rank.
+			BuddyOffset_t offset = __buddy_shared_allocator_off(ba, chunk);
+			Rank_t rank = chunk->rank;
+			const BuddySharedHdr_t* buddy = __buddy_shared_allocator_hdr(ba, __buddy_shared_allocator_buddy(ba, offset, rank));
+			while(buddy && !(buddy->busy) && buddy->rank == rank) {
+				const BuddyOffset_t buddy_off = __buddy_shared_allocator_off(ba, buddy);
+				offset = buddy_off < offset ? buddy_off : offset;
+				rank++;
+				buddy = __buddy_shared_allocator_hdr(ba, __buddy_shared_allocator_buddy(ba, offset, rank));
+			}
+
+			if(__buddy_file_arena_log(ins, BUDDY_FILE_LOG_FREE, offset, rank, 0) == 0) {
+				__buddy_shared_allocator_free_locked(ba, raw_ptr);
+			}
+		}
+		__buddy_shared_allocator_unlock(ba);
+	}
+}
+
+/**
+* Store the root object of the persistent structure, the only pointer known on the next open.
+* The header page is synced.
+* @param ins The arena instance pointer. MUST NOT be null.
+* @param ptr A pointer returned by buddy_file_arena_alloc() or NULL.
+*/
+static inline void buddy_file_arena_set_root(BuddyFileArena_t* const ins, void* const ptr) {
+	if(__buddy_shared_allocator_lock(ins->allocator) == 0) {
+		ins->header->root = buddy_shared_allocator_offset(ins->allocator, ptr);
+		__buddy_file_arena_sync(ins->header, sizeof(*(ins->header)));
+		__buddy_shared_allocator_unlock(ins->allocator);
+	}
+}
+
+/**
+* @param ins The arena instance pointer. MUST NOT be null.
+* @return the root object of the persistent structure or NULL.
+*/
+static inline void* buddy_file_arena_root(BuddyFileArena_t* const ins) {
+	return buddy_shared_allocator_ptr(ins->allocator, ins->header->root);
+}
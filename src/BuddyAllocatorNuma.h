@@ -0,0 +1,409 @@
+#pragma once
+
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "BuddyAllocator.h"
+
+// =========================================================
+// = NUMA aware buddy allocator.
+//
+// One BuddyAllocator_t per node. The nodes memory is a single virtual
+// reservation split into equal power of two slices, every slice is bound
+// to its node with mbind(2), so the owning node of any pointer is
+// calculated without a lookup.
+//
+// = reservation layout
+//
+// | < -- 2^rank -- > | < -- 2^rank -- > |     | < -- 2^rank -- > |
+// [ node 0 slice     ][ node 1 slice     ] ... [ node N-1 slice   ]
+// |
+// memory_ptr
+//
+// node(ptr) = (ptr - memory_ptr) >> rank
+//
+// The topology is pluggable, so a multi-node layout can be simulated
+// on a single node box.
+//
+// = threading
+//
+// Every node allocator is guarded by its own mutex, so any thread may
+// allocate and free concurrently. Threads running on different nodes
+// do not contend unless the fallback or a cross node free reaches the
+// same node. create() and destroy() MUST NOT race with anything else.
+//
+// The pressure handlers of a node are registered with the NUMA allocator,
+// not with the node allocator: the node allocator only records the ranks
+// under pressure while the node is locked, the handlers are called after
+// it is unlocked, so they may free through the NUMA allocator, and a
+// failed allocation is retried once.
+// =========================================================
+
+
+// ====================================
+// = Types definitions.
+// ====================================
+typedef uint8_t NodeId_t;
+
+typedef enum {
+	BUDDY_NUMA_FALLBACK_NONE = 0,   // Allocate from the local node only.
+	BUDDY_NUMA_FALLBACK_REMOTE = 1, // Try the other nodes in a round robin order starting from local+1.
+} BuddyNumaFallback_t;
+
+typedef struct {
+	unsigned nodes_nb;
+
+	/**
+	 * Returns the node the calling thread currently runs on.
+	 * NULL means the getcpu(2) system call is used.
+	 */
+	NodeId_t (*current_node)(void* ctx);
+	void* current_node_ctx;
+
+	/**
+	 * Bind every slice to its node with mbind(2).
+	 * Must be false for a simulated topology.
+	 */
+	bool bind;
+} BuddyNumaTopology_t;
+
+
+// ====================================
+// = Static configuration.
+// ====================================
+#define __BUDDY_NUMA_NODES_MAX (unsigned)(64)
+#define __BUDDY_NUMA_MPOL_BIND (int)(2)
+
+
+typedef struct {
+	BuddyAllocator_t* nodes[__BUDDY_NUMA_NODES_MAX];
+	pthread_mutex_t locks[__BUDDY_NUMA_NODES_MAX];
+	uint64_t pressure_pending[__BUDDY_NUMA_NODES_MAX]; // A bit per rank, guarded by the node lock.
+	BuddyPressureHandler_t pressure_handlers[__BUDDY_NUMA_NODES_MAX][__BUDDY_ALLOCATOR_PRESSURE_HANDLERS_MAX];
+	size_t pressure_handlers_nb[__BUDDY_NUMA_NODES_MAX];
+	uint8_t* memory_ptr;
+	size_t memory_size;
+	Rank_t node_rank;
+	BuddyNumaTopology_t topology;
+	BuddyNumaFallback_t fallback;
+} BuddyNumaAllocator_t;
+
+
+// ====================================
+// = Private methods.
+// ====================================
+
+static inline NodeId_t __buddy_numa_allocator_current_node(const BuddyNumaAllocator_t* const ins) {
+	NodeId_t result = 0;
+	if(ins->topology.current_node) {
+		result = ins->topology.current_node(ins->topology.current_node_ctx);
+	} else {
+		unsigned cpu = 0;
+		unsigned node = 0;
+		if(syscall(SYS_getcpu, &cpu, &node, NULL) == 0) {
+			result = (NodeId_t)node;
+		}
+	}
+	return result < ins->topology.nodes_nb ? result : 0;
+}
+
+/**
+ * Binds the memory area to a single node.
+ * @return zero on success.
+ */
+static inline int __buddy_numa_allocator_bind(void* const ptr, const size_t size, const NodeId_t node) {
+	unsigned long nodemask[__BUDDY_NUMA_NODES_MAX / (8u * sizeof(unsigned long))] = {0};
+	nodemask[node / (8u * sizeof(unsigned long))] = 1ul << (node % (8u * sizeof(unsigned long)));
+	// The kernel reads maxnode - 1 bits of the mask.
+	return (int)syscall(SYS_mbind, ptr, size, __BUDDY_NUMA_MPOL_BIND, nodemask, (unsigned long)__BUDDY_NUMA_NODES_MAX + 1u, 0u);
+}
+
+/**
+ * The only pressure handler of every node allocator, called with the node lock held.
+ * Records the rank, the NUMA handlers are called once the node is unlocked.
+ */
+static inline void __buddy_numa_allocator_pressure_defer(void* ctx, Rank_t rank) {
+	*(uint64_t*)ctx |= 1ull << rank;
+}
+
+/**
+ * Allocates from a single node under its lock.
+ * @return the ranks under pressure, a bit per rank.
+ */
+static inline uint64_t __buddy_numa_allocator_node_alloc_locked(
+	BuddyNumaAllocator_t* const ins, const NodeId_t node, const size_t size, void** const result
+                                                                ) {
+	pthread_mutex_lock(&ins->locks[node]);
+	*result = buddy_allocator_alloc(ins->nodes[node], size);
+	const uint64_t pending = ins->pressure_pending[node];
+	ins->pressure_pending[node] = 0;
+	pthread_mutex_unlock(&ins->locks[node]);
+	return pending;
+}
+
+static inline void __buddy_numa_allocator_pressure(BuddyNumaAllocator_t* const ins, const NodeId_t node, uint64_t pending) {
+	while(pending) {
+		const Rank_t rank = (Rank_t)__builtin_ctzll(pending);
+		pending &= pending - 1u;
+		for(size_t idx = 0; idx < ins->pressure_handlers_nb[node]; ++idx) {
+			ins->pressure_handlers[node][idx].callback(ins->pressure_handlers[node][idx].ctx, rank);
+		}
+	}
+}
+
+/**
+ * Allocates from a single node.
+ * The pressure handlers are called with no lock held, then a failed allocation is retried once.
+ */
+static inline void* __buddy_numa_allocator_node_alloc(BuddyNumaAllocator_t* const ins, const NodeId_t node, const size_t size) {
+	void* result = NULL;
+	const uint64_t pending = __buddy_numa_allocator_node_alloc_locked(ins, node, size, &result);
+	if(pending && ins->pressure_handlers_nb[node]) {
+		__buddy_numa_allocator_pressure(ins, node, pending);
+		if(result == NULL) {
+			__buddy_numa_allocator_pressure(ins, node, __buddy_numa_allocator_node_alloc_locked(ins, node, size, &result));
+		}
+	}
+	return result;
+}
+
+
+// ====================================
+// = Public methods.
+// ====================================
+
+/**
+* Fill the topology of the running system.
+* The nodes are assumed to be numbered contiguously from zero.
+* @param topology The topology to fill. MUST NOT be null.
+* @return zero on success.
+*/
+static inline int buddy_numa_topology_system(BuddyNumaTopology_t* const topology) {
+	int result = -1;
+	FILE* const file = fopen("/sys/devices/system/node/online", "r");
+	if(file) {
+		unsigned first = 0;
+		unsigned last = 0;
+		const int matched = fscanf(file, "%u-%u", &first, &last);
+		if(matched >= 1) {
+			if(matched == 1) {
+				last = first;
+			}
+			if(last < __BUDDY_NUMA_NODES_MAX) {
+				memset(topology, 0, sizeof(*topology));
+				topology->nodes_nb = last + 1u;
+				topology->bind = true;
+				result = 0;
+			}
+		}
+		fclose(file);
+	}
+	return result;
+}
+
+/**
+* Create a NUMA aware buddy allocator.
+* @param topology The nodes topology. MUST NOT be null.
+* @param node_memory_size The memory size per node. MUST BE a power of two value.
+* @param fallback What to do when the local node is out of memory.
+* @return the new allocator pointer or NULL in case of any errors.
+*/
+static inline BuddyNumaAllocator_t* buddy_numa_allocator_create(
+	const BuddyNumaTopology_t* const topology,
+	const size_t node_memory_size,
+	const BuddyNumaFallback_t fallback
+                                                               ) {
+	BuddyNumaAllocator_t* result = NULL;
+
+	if(topology->nodes_nb && topology->nodes_nb <= __BUDDY_NUMA_NODES_MAX && __buddy_allocator_is_po2(node_memory_size)) {
+		result = (BuddyNumaAllocator_t*)malloc(sizeof(*result));
+
+		if(result) {
+			memset(result, 0, sizeof(*result));
+			result->topology = *topology;
+			result->fallback = fallback;
+			result->node_rank = __buddy_allocator_rank(node_memory_size);
+			result->memory_size = node_memory_size * topology->nodes_nb;
+
+			void* const memory = mmap(NULL, result->memory_size, PROT_READ | PROT_WRITE,
+			                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+			bool success = (memory != MAP_FAILED);
+
+			if(success) {
+				result->memory_ptr = (uint8_t*)memory;
+
+				// Bind before anything touches the slice, so the first touch faults on the right node.
+				for(NodeId_t node = 0; success && node < topology->nodes_nb; ++node) {
+					uint8_t* const slice = result->memory_ptr + ((size_t)node << result->node_rank);
+					if(topology->bind) {
+						success = (__buddy_numa_allocator_bind(slice, node_memory_size, node) == 0);
+					}
+					if(success) {
+						result->nodes[node] = buddy_allocator_create(slice, node_memory_size);
+						success = (result->nodes[node] != NULL);
+					}
+					if(success) {
+						buddy_allocator_pressure_register(result->nodes[node], __buddy_numa_allocator_pressure_defer, result->pressure_pending + node);
+					}
+					if(success) {
+						success = (pthread_mutex_init(&result->locks[node], NULL) == 0);
+						if(!success) {
+							buddy_allocator_destroy(result->nodes[node]);
+							result->nodes[node] = NULL;
+						}
+					}
+				}
+			}
+
+			if(!success) {
+				for(NodeId_t node = 0; node < topology->nodes_nb; ++node) {
+					if(result->nodes[node]) {
+						pthread_mutex_destroy(&result->locks[node]);
+						buddy_allocator_destroy(result->nodes[node]);
+					}
+				}
+				if(result->memory_ptr) {
+					munmap(result->memory_ptr, result->memory_size);
+				}
+				free(result);
+				result = NULL;
+			}
+		}
+	}
+	return result;
+}
+
+/**
+* Destroy a NUMA aware buddy allocator and release the nodes memory.
+* @param ins The allocator instance pointer. MUST NOT be null.
+*/
+static inline void buddy_numa_allocator_destroy(BuddyNumaAllocator_t* const ins) {
+	for(NodeId_t node = 0; node < ins->topology.nodes_nb; ++node) {
+		pthread_mutex_destroy(&ins->locks[node]);
+		buddy_allocator_destroy(ins->nodes[node]);
+	}
+	munmap(ins->memory_ptr, ins->memory_size);
+	free(ins);
+}
+
+/**
+* Find the node owning the memory area.
+* @param ins The allocator instance pointer. MUST NOT be null.
+* @param ptr A pointer returned by buddy_numa_allocator_alloc(). MUST NOT be null.
+*/
+static inline NodeId_t buddy_numa_allocator_node_of(const BuddyNumaAllocator_t* const ins, const void* const ptr) {
+	const size_t offset = (const uint8_t*)ptr - ins->memory_ptr;
+	return (NodeId_t)(offset >> ins->node_rank);
+}
+
+/**
+* Register a memory pressure handler of a node.
+* The handler is called with no lock held, it may free through the NUMA allocator.
+* MUST NOT race with allocations.
+* @param ins The allocator instance pointer. MUST NOT be null.
+* @param node The node id.
+* @param callback The handler. MUST NOT be null.
+* @param ctx The handler context.
+* @return zero on success or -1 if there are too many handlers or no such node.
+*/
+static inline int buddy_numa_allocator_pressure_register(
+	BuddyNumaAllocator_t* const ins, const NodeId_t node, BuddyPressureCallback_t callback, void* ctx
+                                                        ) {
+	int result = -1;
+	if(node < ins->topology.nodes_nb && ins->pressure_handlers_nb[node] < __BUDDY_ALLOCATOR_PRESSURE_HANDLERS_MAX) {
+		ins->pressure_handlers[node][ins->pressure_handlers_nb[node]].callback = callback;
+		ins->pressure_handlers[node][ins->pressure_handlers_nb[node]].ctx = ctx;
+		ins->pressure_handlers_nb[node]++;
+		result = 0;
+	}
+	return result;
+}
+
+/**
+* Unregister a memory pressure handler of a node.
+* MUST NOT race with allocations.
+* @param ins The allocator instance pointer. MUST NOT be null.
+* @param node The node id.
+* @param callback The handler.
+* @param ctx The handler context.
+*/
+static inline void buddy_numa_allocator_pressure_unregister(
+	BuddyNumaAllocator_t* const ins, const NodeId_t node, BuddyPressureCallback_t callback, void* ctx
+                                                           ) {
+	if(node < ins->topology.nodes_nb) {
+		for(size_t idx = 0; idx < ins->pressure_handlers_nb[node]; ++idx) {
+			if(ins->pressure_handlers[node][idx].callback == callback && ins->pressure_handlers[node][idx].ctx == ctx) {
+				ins->pressure_handlers_nb[node]--;
+				ins->pressure_handlers[node][idx] = ins->pressure_handlers[node][ins->pressure_handlers_nb[node]];
+				break;
+			}
+		}
+	}
+}
+
+/**
+* Set the free space watermark of a rank of a node.
+* @param ins The allocator instance pointer. MUST NOT be null.
+* @param node The node id.
+* @param rank The rank.
+* @param chunks_nb The minimal free space in chunks of the rank, zero disables the watermark.
+*/
+static inline void buddy_numa_allocator_set_watermark(
+	BuddyNumaAllocator_t* const ins, const NodeId_t node, const Rank_t rank, const size_t chunks_nb
+                                                     ) {
+	if(node < ins->topology.nodes_nb) {
+		pthread_mutex_lock(&ins->locks[node]);
+		buddy_allocator_set_watermark(ins->nodes[node], rank, chunks_nb);
+		pthread_mutex_unlock(&ins->locks[node]);
+	}
+}
+
+/**
+* Allocate memory from the explicitly given node.
+* No fallback is applied.
+* @param ins The allocator instance pointer. MUST NOT be null.
+* @param node The node id.
+* @param size Size of memory to allocate
+* @return pointer to the newly allocated memory , or @a NULL if out of memory
+*/
+static inline void* buddy_numa_allocator_alloc_on_node(BuddyNumaAllocator_t* const ins, const NodeId_t node, const size_t size) {
+	void* result = NULL;
+	if(node < ins->topology.nodes_nb) {
+		result = __buddy_numa_allocator_node_alloc(ins, node, size);
+	}
+	return result;
+}
+
+/**
+* Allocate memory from the node the calling thread runs on.
+* @param ins The allocator instance pointer. MUST NOT be null.
+* @param size Size of memory to allocate
+* @return pointer to the newly allocated memory , or @a NULL if out of memory
+*/
+static inline void* buddy_numa_allocator_alloc(BuddyNumaAllocator_t* const ins, const size_t size) {
+	const NodeId_t local = __buddy_numa_allocator_current_node(ins);
+	void* result = __buddy_numa_allocator_node_alloc(ins, local, size);
+
+	if(result == NULL && ins->fallback == BUDDY_NUMA_FALLBACK_REMOTE) {
+		for(unsigned step = 1; result == NULL && step < ins->topology.nodes_nb; ++step) {
+			const NodeId_t node = (NodeId_t)((local + step) % ins->topology.nodes_nb);
+			result = __buddy_numa_allocator_node_alloc(ins, node, size);
+		}
+	}
+	return result;
+}
+
+/**
+* Deallocates a perviously allocated memory area on any node.
+* If @a ptr is @a NULL , it simply returns
+* @param ins The allocator instance pointer. MUST NOT be null.
+* @param raw_ptr The memory area to deallocate.
+*/
+static inline void buddy_numa_allocator_free(BuddyNumaAllocator_t* const ins, void* const raw_ptr) {
+	if(raw_ptr) {
+		const NodeId_t node = buddy_numa_allocator_node_of(ins, raw_ptr);
+		pthread_mutex_lock(&ins->locks[node]);
+		buddy_allocator_free(ins->nodes[node], raw_ptr);
+		pthread_mutex_unlock(&ins->locks[node]);
+	}
+}
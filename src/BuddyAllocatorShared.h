@@ -0,0 +1,514 @@
+#pragma once
+
+#include <pthread.h>
+#include <errno.h>
+#include "BuddyAllocator.h"
+
+// =========================================================
+// = Shared memory (multi-process) buddy allocator.
+//
+// The control structure lives at the beginning of the shared region,
+// the chunks follow it. All the links are offsets from the control
+// structure address, so every process may map the region at its own
+// address.
+//
+// = region layout
+//
+// | < ------------------ shm_size bytes ------------------ > |
+//
+// [ BuddySharedAllocator_t ][ pad ][ Raw memory (2^rank)    ]
+// |                                |
+// Offset 0                         raw_memory_off
+//
+// Offset 0 always points to the control structure and is never a chunk,
+// so it is used as the NULL link.
+//
+// = crash consistency
+//
+// The chunk headers are written in such an order that walking the chunks
+// in address order (hopping by 2^rank) is valid at any point:
+// - a split writes the upper buddy header before shrinking the lower one;
+// - a chunk is marked busy only after the split cascade is done;
+// - a freed chunk is marked free before the merge cascade starts.
+// So the free lists can always be rebuilt from the headers alone, see
+// buddy_shared_allocator_recover(). It is done automatically when the
+// mutex owner dies.
+// =========================================================
+
+
+// ====================================
+// = Types definitions.
+// ====================================
+typedef uint64_t BuddyOffset_t;
+
+struct BuddySharedChunkHeader {
+	BuddyOffset_t prev;
+	BuddyOffset_t next;
+	Rank_t rank;
+	bool busy;
+};
+
+typedef struct BuddySharedChunkHeader BuddySharedHdr_t;
+
+
+// ====================================
+// = Static configuration.
+// ====================================
+#define __BUDDY_SHARED_ALLOCATOR_MAGIC (uint64_t)(0x4255444459534852ull) // "BUDDYSHR"
+#define __BUDDY_SHARED_ALLOCATOR_ALIGN (size_t)(64)
+#define __BUDDY_SHARED_ALLOCATOR_NIL (BuddyOffset_t)(0)
+
+
+typedef struct {
+	uint64_t magic;
+	pthread_mutex_t mutex;
+	BuddyOffset_t buckets[__BUDDY_ALLOCATOR_RANK_RANGE + 1u];
+	BuddyOffset_t raw_memory_off;
+	Rank_t raw_memory_rank;
+} BuddySharedAllocator_t;
+
+
+// ====================================
+// = Private methods.
+// ====================================
+
+/**
+ * Translates an offset to a header pointer including NIL.
+ */
+static inline BuddySharedHdr_t* __buddy_shared_allocator_hdr(
+	BuddySharedAllocator_t* const ins, const BuddyOffset_t offset
+                                                            ) {
+	BuddySharedHdr_t* result = NULL;
+	if(offset != __BUDDY_SHARED_ALLOCATOR_NIL) {
+		result = (BuddySharedHdr_t*)((uint8_t*)ins + offset);
+	}
+	return result;
+}
+
+/**
+ * Translates a header pointer to its offset.
+ */
+static inline BuddyOffset_t __buddy_shared_allocator_off(
+	const BuddySharedAllocator_t* const ins, const BuddySharedHdr_t* const chunk
+                                                        ) {
+	return (BuddyOffset_t)((const uint8_t*)chunk - (const uint8_t*)ins);
+}
+
+/**
+ * Calculates the buddy offset.
+ * May return NIL.
+ */
+static inline BuddyOffset_t __buddy_shared_allocator_buddy(
+	const BuddySharedAllocator_t* const ins, const BuddyOffset_t offset, const Rank_t rank
+                                                          ) {
+	BuddyOffset_t result = __BUDDY_SHARED_ALLOCATOR_NIL;
+	if(rank < ins->raw_memory_rank) {
+		result = ((offset - ins->raw_memory_off) ^ (1ull << rank)) + ins->raw_memory_off;
+	}
+	return result;
+}
+
+static inline void __buddy_shared_allocator_list_push(
+	BuddySharedAllocator_t* const ins, const BucketId_t bucket, BuddySharedHdr_t* const chunk
+                                                     ) {
+	const BuddyOffset_t chunk_off = __buddy_shared_allocator_off(ins, chunk);
+	BuddySharedHdr_t* const head = __buddy_shared_allocator_hdr(ins, ins->buckets[bucket]);
+	chunk->prev = __BUDDY_SHARED_ALLOCATOR_NIL;
+	chunk->next = ins->buckets[bucket];
+	if(head) {
+		head->prev = chunk_off;
+	}
+	ins->buckets[bucket] = chunk_off;
+}
+
+static inline void __buddy_shared_allocator_list_remove(
+	BuddySharedAllocator_t* const ins, const BucketId_t bucket, BuddySharedHdr_t* const chunk
+                                                       ) {
+	BuddySharedHdr_t* const prev = __buddy_shared_allocator_hdr(ins, chunk->prev);
+	BuddySharedHdr_t* const next = __buddy_shared_allocator_hdr(ins, chunk->next);
+	if(prev) {
+		prev->next = chunk->next;
+	} else {
+		ins->buckets[bucket] = chunk->next;
+	}
+	if(next) {
+		next->prev = chunk->prev;
+	}
+}
+
+/**
+ * Pushes a chunk to the free list.
+ */
+static inline void __buddy_shared_allocator_push_chunk(
+	BuddySharedAllocator_t* const ins, BuddySharedHdr_t* const chunk
+                                                      ) {
+	const BucketId_t bucket = chunk->rank - __BUDDY_ALLOCATOR_RANK_MIN;
+	const BuddyOffset_t chunk_off = __buddy_shared_allocator_off(ins, chunk);
+	const BuddyOffset_t buddy_off = __buddy_shared_allocator_buddy(ins, chunk_off, chunk->rank);
+	BuddySharedHdr_t* const buddy = __buddy_shared_allocator_hdr(ins, buddy_off);
+
+	if(buddy && !(buddy->busy) && buddy->rank == chunk->rank) {
+		BuddySharedHdr_t* const parent = chunk < buddy ? chunk : buddy;
+		__buddy_shared_allocator_list_remove(ins, bucket, buddy);
+		parent->rank++;
+		__buddy_shared_allocator_push_chunk(ins, parent);
+	} else {
+		chunk->busy = false;
+		__buddy_shared_allocator_list_push(ins, bucket, chunk);
+	}
+}
+
+/**
+ * Pops a chunk from the free list.
+ * May returns NULL.
+ */
+static inline BuddySharedHdr_t* __buddy_shared_allocator_pop_chunk(
+	BuddySharedAllocator_t* const ins, const Rank_t rank
+                                                                  ) {
+	BuddySharedHdr_t* result = NULL;
+	if(rank >= __BUDDY_ALLOCATOR_RANK_MIN && rank <= ins->raw_memory_rank) {
+		const BucketId_t bucket = rank - __BUDDY_ALLOCATOR_RANK_MIN;
+
+		if(ins->buckets[bucket] == __BUDDY_SHARED_ALLOCATOR_NIL) {
+
+			result = __buddy_shared_allocator_pop_chunk(ins, (Rank_t) (rank + 1u));
+			if(result) {
+				const BuddyOffset_t result_off = __buddy_shared_allocator_off(ins, result);
+				const BuddyOffset_t buddy_off = __buddy_shared_allocator_buddy(ins, result_off, rank);
+				BuddySharedHdr_t* const buddy = __buddy_shared_allocator_hdr(ins, buddy_off);
+				if(buddy) {
+					buddy->rank = rank;
+					buddy->busy = false;
+					__buddy_shared_allocator_list_push(ins, bucket, buddy);
+				}
+
+				// The buddy header must be valid before the chunk stops covering it.
+				__atomic_signal_fence(__ATOMIC_SEQ_CST);
+				result->rank = rank;
+			}
+
+		} else {
+			result = __buddy_shared_allocator_hdr(ins, ins->buckets[bucket]);
+			__buddy_shared_allocator_list_remove(ins, bucket, result);
+		}
+
+	}
+	return result;
+}
+
+/**
+ * Merges the free buddies left unmerged by an interrupted free.
+ * All the free chunks MUST BE in the free lists.
+ */
+static inline void __buddy_shared_allocator_coalesce(BuddySharedAllocator_t* const ins) {
+	for(Rank_t rank = __BUDDY_ALLOCATOR_RANK_MIN; rank < ins->raw_memory_rank; ++rank) {
+		const BucketId_t bucket = rank - __BUDDY_ALLOCATOR_RANK_MIN;
+		BuddySharedHdr_t* chunk = __buddy_shared_allocator_hdr(ins, ins->buckets[bucket]);
+		while(chunk) {
+			const BuddyOffset_t chunk_off = __buddy_shared_allocator_off(ins, chunk);
+			BuddySharedHdr_t* const buddy = __buddy_shared_allocator_hdr(ins, __buddy_shared_allocator_buddy(ins, chunk_off, rank));
+
+			if(!(buddy->busy) && buddy->rank == rank) {
+				BuddySharedHdr_t* const parent = chunk < buddy ? chunk : buddy;
+				__buddy_shared_allocator_list_remove(ins, bucket, chunk);
+				__buddy_shared_allocator_list_remove(ins, bucket, buddy);
+				parent->rank++;
+				__buddy_shared_allocator_list_push(ins, (BucketId_t)(bucket + 1u), parent);
+
+				// The list has been modified, start over.
+				chunk = __buddy_shared_allocator_hdr(ins, ins->buckets[bucket]);
+			} else {
+				chunk = __buddy_shared_allocator_hdr(ins, chunk->next);
+			}
+		}
+	}
+}
+
+static inline int __buddy_shared_allocator_mutex_init(BuddySharedAllocator_t* const ins) {
+	pthread_mutexattr_t attr;
+	int result = pthread_mutexattr_init(&attr);
+	if(result == 0) {
+		result = pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+		if(result == 0) {
+			result = pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+		}
+		if(result == 0) {
+			result = pthread_mutex_init(&ins->mutex, &attr);
+		}
+		pthread_mutexattr_destroy(&attr);
+	}
+	return result;
+}
+
+static inline int buddy_shared_allocator_recover(BuddySharedAllocator_t* const ins);
+
+/**
+ * Acquires the process-shared mutex.
+ * If a previous owner died while holding it, the free lists are rebuilt
+ * before the mutex is marked consistent.
+ */
+static inline int __buddy_shared_allocator_lock(BuddySharedAllocator_t* const ins) {
+	int result = pthread_mutex_lock(&ins->mutex);
+	if(result == EOWNERDEAD) {
+		result = buddy_shared_allocator_recover(ins);
+		if(result == 0) {
+			result = pthread_mutex_consistent(&ins->mutex);
+		} else {
+			pthread_mutex_unlock(&ins->mutex);
+		}
+	}
+	return result;
+}
+
+static inline void __buddy_shared_allocator_unlock(BuddySharedAllocator_t* const ins) {
+	pthread_mutex_unlock(&ins->mutex);
+}
+
+/**
+ * The rank of the chunk fitting the size.
+ * @return zero if the size does not fit the arena.
+ */
+static inline Rank_t __buddy_shared_allocator_size_rank(const BuddySharedAllocator_t* const ins, const size_t size) {
+	Rank_t result = 0;
+	if(size < __BUDDY_ALLOCATOR_CAPACITY_MAX) {
+		Rank_t rank = __buddy_allocator_rank(size + sizeof(BuddySharedHdr_t));
+		if(rank <= ins->raw_memory_rank) {
+			result = rank < __BUDDY_ALLOCATOR_RANK_MIN ? __BUDDY_ALLOCATOR_RANK_MIN : rank;
+		}
+	}
+	return result;
+}
+
+/**
+ * Pops a chunk of the rank and marks it busy.
+ * MUST BE called with the mutex held.
+ */
+static inline void* __buddy_shared_allocator_alloc_locked(BuddySharedAllocator_t* const ins, const Rank_t rank) {
+	void* result = NULL;
+	BuddySharedHdr_t* const chunk = __buddy_shared_allocator_pop_chunk(ins, rank);
+	if(chunk) {
+		chunk->busy = true;
+		result = (void*)(chunk + 1);
+	}
+	return result;
+}
+
+/**
+ * Returns a busy chunk to the free lists.
+ * MUST BE called with the mutex held.
+ */
+static inline void __buddy_shared_allocator_free_locked(BuddySharedAllocator_t* const ins, void* const raw_ptr) {
+	BuddySharedHdr_t* const chunk = (BuddySharedHdr_t*)raw_ptr - 1;
+	if(chunk->busy) {
+		chunk->busy = false;
+		__atomic_signal_fence(__ATOMIC_SEQ_CST);
+		__buddy_shared_allocator_push_chunk(ins, chunk);
+	}
+}
+
+/**
+ * @warning For debug purposes only.
+ * @param ins The shared buddy allocator instance pointer. MUST NOT be null.
+ */
+static inline void __buddy_shared_allocator_dump(BuddySharedAllocator_t* const ins) {
+	printf("==== Shared Buddy Allocator instance ====\n");
+	printf("Struct ptr                  : %p\n", ins);
+	printf("BuddySharedAllocator_t size : %zu\n", sizeof(*ins));
+	printf("BuddySharedHdr_t size       : %zu\n", sizeof(BuddySharedHdr_t));
+	printf("Raw mem offset              : %zu\n", (size_t)ins->raw_memory_off);
+	printf("Raw mem rank                : %u\n", ins->raw_memory_rank);
+
+	Rank_t rank = ins->raw_memory_rank;
+	while(rank >= __BUDDY_ALLOCATOR_RANK_MIN) {
+		const Rank_t bucket = rank - __BUDDY_ALLOCATOR_RANK_MIN;
+		printf("[ Bucket=%-2u  Rank=%-2u  Size=%-8zu ] : ", bucket, rank, (size_t)(1ull << rank));
+		const BuddySharedHdr_t* head = __buddy_shared_allocator_hdr(ins, ins->buckets[bucket]);
+		while(head) {
+			printf("[ Offset=%zu Rank=%u Busy=%d] -> ",
+			       (size_t)(__buddy_shared_allocator_off(ins, head) - ins->raw_memory_off), head->rank, head->busy);
+			head = __buddy_shared_allocator_hdr(ins, head->next);
+		}
+		printf("\n");
+		rank--;
+	}
+}
+
+
+// ====================================
+// = Public methods.
+// ====================================
+
+/**
+ * @param ins The shared buddy allocator instance pointer. MUST NOT be null.
+ * @return The maximum chunk size that can be allocated.
+ */
+static inline size_t buddy_shared_allocator_capacity_max(const BuddySharedAllocator_t* const ins) {
+	return (1ull << ins->raw_memory_rank) - sizeof(BuddySharedHdr_t);
+}
+
+/**
+* Create a shared buddy allocator in place.
+* The biggest power of two area which fits the region after the control structure is managed,
+* up to 2^RANK_MAX bytes, the rest of a larger region is left unused.
+* Must be called by exactly one process before any other process attaches.
+* @param shm The shared region. MUST NOT be null. MUST BE aligned to at least 8 bytes.
+* @param shm_size The shared region size.
+* @return the control structure pointer (== shm) or NULL in case of any errors.
+*/
+static inline BuddySharedAllocator_t* buddy_shared_allocator_create(void* shm, const size_t shm_size) {
+	BuddySharedAllocator_t* result = NULL;
+	const size_t raw_off = (sizeof(*result) + __BUDDY_SHARED_ALLOCATOR_ALIGN - 1u) & ~(__BUDDY_SHARED_ALLOCATOR_ALIGN - 1u);
+
+	if(shm && shm_size > raw_off) {
+		Rank_t rank = __buddy_allocator_rank(shm_size - raw_off);
+		if((1ull << rank) > shm_size - raw_off) {
+			rank--;
+		}
+		if(rank > __BUDDY_ALLOCATOR_RANK_MAX) {
+			rank = __BUDDY_ALLOCATOR_RANK_MAX;
+		}
+
+		if(rank >= __BUDDY_ALLOCATOR_RANK_MIN) {
+			BuddySharedAllocator_t* const ins = (BuddySharedAllocator_t*)shm;
+			memset(ins, 0, sizeof(*ins));
+
+			if(__buddy_shared_allocator_mutex_init(ins) == 0) {
+				ins->raw_memory_off = raw_off;
+				ins->raw_memory_rank = rank;
+
+				BuddySharedHdr_t* const chunk = __buddy_shared_allocator_hdr(ins, raw_off);
+				chunk->rank = rank;
+				__buddy_shared_allocator_push_chunk(ins, chunk);
+
+				__atomic_store_n(&ins->magic, __BUDDY_SHARED_ALLOCATOR_MAGIC, __ATOMIC_RELEASE);
+				result = ins;
+			}
+		}
+	}
+	return result;
+}
+
+/**
+* Rebuild the free lists from the chunk headers.
+* Call it when the allocator state may have been left half updated, e.g. the
+* region is a file which was not flushed before a crash.
+* MUST BE called with exclusive access to the allocator.
+* @param ins The shared buddy allocator instance pointer. MUST NOT be null.
+* @return zero on success or -1 if a chunk header is corrupted.
+*/
+static inline int buddy_shared_allocator_recover(BuddySharedAllocator_t* const ins) {
+	int result = 0;
+	const size_t raw_size = 1ull << ins->raw_memory_rank;
+
+	for(Rank_t idx = 0; idx <= __BUDDY_ALLOCATOR_RANK_RANGE; ++idx) {
+		ins->buckets[idx] = __BUDDY_SHARED_ALLOCATOR_NIL;
+	}
+
+	size_t offset = 0;
+	while(result == 0 && offset < raw_size) {
+		BuddySharedHdr_t* const chunk = __buddy_shared_allocator_hdr(ins, ins->raw_memory_off + offset);
+		const Rank_t rank = chunk->rank;
+		const size_t size = 1ull << rank;
+
+		if(rank >= __BUDDY_ALLOCATOR_RANK_MIN && rank <= ins->raw_memory_rank && (offset & (size - 1u)) == 0) {
+			if(!(chunk->busy)) {
+				__buddy_shared_allocator_list_push(ins, (BucketId_t)(rank - __BUDDY_ALLOCATOR_RANK_MIN), chunk);
+			}
+			offset += size;
+		} else {
+			result = -1;
+		}
+	}
+
+	if(result == 0) {
+		__buddy_shared_allocator_coalesce(ins);
+	}
+	return result;
+}
+
+/**
+* Attach to a shared buddy allocator created by another process.
+* @param shm The shared region as mapped by the calling process. MUST NOT be null.
+* @return the control structure pointer (== shm) or NULL if the region holds no allocator.
+*/
+static inline BuddySharedAllocator_t* buddy_shared_allocator_attach(void* shm) {
+	BuddySharedAllocator_t* result = NULL;
+	BuddySharedAllocator_t* const ins = (BuddySharedAllocator_t*)shm;
+	if(ins && __atomic_load_n(&ins->magic, __ATOMIC_ACQUIRE) == __BUDDY_SHARED_ALLOCATOR_MAGIC) {
+		result = ins;
+	}
+	return result;
+}
+
+/**
+* Destroy a shared buddy allocator.
+* Must be called by exactly one process after all the others stopped using it.
+* The shared region itself is not unmapped.
+* @param ins The shared buddy allocator instance pointer. MUST NOT be null.
+*/
+static inline void buddy_shared_allocator_destroy(BuddySharedAllocator_t* const ins) {
+	if(ins->magic == __BUDDY_SHARED_ALLOCATOR_MAGIC) {
+		ins->magic = 0;
+		pthread_mutex_destroy(&ins->mutex);
+	}
+}
+
+/**
+* Allocate memory
+* @param ins The shared buddy allocator instance pointer. MUST NOT be null.
+* @param size Size of memory to allocate
+* @return pointer to the newly allocated memory , or @a NULL if out of memory
+*/
+static inline void* buddy_shared_allocator_alloc(BuddySharedAllocator_t* const ins, const size_t size) {
+	void* result = NULL;
+	const Rank_t rank = __buddy_shared_allocator_size_rank(ins, size);
+	if(rank && __buddy_shared_allocator_lock(ins) == 0) {
+		result = __buddy_shared_allocator_alloc_locked(ins, rank);
+		__buddy_shared_allocator_unlock(ins);
+	}
+	return result;
+}
+
+/**
+* Deallocates a perviously allocated memory area.
+* If @a ptr is @a NULL , it simply returns
+* @param ins The shared buddy allocator instance pointer. MUST NOT be null.
+* @param raw_ptr The memory area to deallocate.
+*/
+static inline void buddy_shared_allocator_free(BuddySharedAllocator_t* const ins, void* const raw_ptr) {
+	if(raw_ptr) {
+		if(__buddy_shared_allocator_lock(ins) == 0) {
+			__buddy_shared_allocator_free_locked(ins, raw_ptr);
+			__buddy_shared_allocator_unlock(ins);
+		}
+	}
+}
+
+/**
+* Translates a pointer inside the shared region to a process independent offset.
+* Use it to store references in the shared region itself.
+* @param ins The shared buddy allocator instance pointer. MUST NOT be null.
+* @param ptr A pointer inside the region or NULL.
+* @return the offset or 0 for NULL.
+*/
+static inline BuddyOffset_t buddy_shared_allocator_offset(const BuddySharedAllocator_t* const ins, const void* const ptr) {
+	BuddyOffset_t result = __BUDDY_SHARED_ALLOCATOR_NIL;
+	if(ptr) {
+		result = (BuddyOffset_t)((const uint8_t*)ptr - (const uint8_t*)ins);
+	}
+	return result;
+}
+
+/**
+* Translates an offset obtained by buddy_shared_allocator_offset() to a pointer in the calling process.
+* @param ins The shared buddy allocator instance pointer. MUST NOT be null.
+* @param offset The offset or 0.
+* @return the pointer or NULL for 0.
+*/
+static inline void* buddy_shared_allocator_ptr(BuddySharedAllocator_t* const ins, const BuddyOffset_t offset) {
+	void* result = NULL;
+	if(offset != __BUDDY_SHARED_ALLOCATOR_NIL) {
+		result = (void*)((uint8_t*)ins + offset);
+	}
+	return result;
+}
@@ -0,0 +1,310 @@
+#pragma once
+
+// =========================================================
+// = Allocation tracing.
+//
+// Included by BuddyAllocator.h, do not include it directly.
+//
+// Define BUDDY_ALLOCATOR_TRACE to enable it. Otherwise all the hooks
+// expand to nothing and the allocator hot path is left untouched.
+//
+// Every thread records into its own ring buffer, the only writer of
+// which is the thread itself. A record is published by a release store
+// of the ring head, so the readers need no locks. The rings are never
+// released, the records of exited threads stay available.
+//
+// Along with the records every ring keeps an HDR-style latency histogram
+// per rank: values below 8 cycles are exact, the larger ones are split
+// into 8 linear sub-buckets per power of two (12.5% precision).
+//
+// = binary dump format (host byte order)
+//
+// [ BuddyTraceFileHdr_t ]
+// [ BuddyTraceRingHdr_t ][ BuddyTraceRecord_t ] ... (ring 0)
+// [ BuddyTraceRingHdr_t ][ BuddyTraceRecord_t ] ... (ring 1)
+// ...
+// =========================================================
+
+#ifdef BUDDY_ALLOCATOR_TRACE
+
+#include <time.h>
+
+
+// ====================================
+// = Static configuration.
+// ====================================
+#define __BUDDY_TRACE_RING_SIZE (size_t)(4096) // MUST BE a power of two value.
+#define __BUDDY_TRACE_HIST_SUB_BITS (unsigned)(3)
+#define __BUDDY_TRACE_HIST_SUB (unsigned)(1u << __BUDDY_TRACE_HIST_SUB_BITS)
+#define __BUDDY_TRACE_HIST_SIZE (unsigned)(64u * __BUDDY_TRACE_HIST_SUB)
+#define __BUDDY_TRACE_RANKS_NB (unsigned)(__BUDDY_ALLOCATOR_RANK_MAX + 1u)
+#define __BUDDY_TRACE_MAGIC (uint64_t)(0x4255444459545243ull) // "BUDDYTRC"
+#define __BUDDY_TRACE_VERSION (uint32_t)(1)
+
+
+// ====================================
+// = Types definitions.
+// ====================================
+typedef enum {
+	BUDDY_TRACE_OP_ALLOC = 0,
+	BUDDY_TRACE_OP_ALLOC_FAILED = 1,
+	BUDDY_TRACE_OP_FREE = 2,
+	BUDDY_TRACE_OP_FREE_REMOTE = 3,
+} BuddyTraceOp_t;
+
+typedef struct {
+	uint64_t timestamp;
+	uint64_t size; // The requested size, zero for frees.
+	uint32_t cycles;
+	uint8_t op;
+	uint8_t rank;
+	uint8_t depth; // The number of splits or merges done.
+	uint8_t reserved;
+} BuddyTraceRecord_t;
+
+typedef struct {
+	uint64_t magic;
+	uint32_t version;
+	uint32_t record_size;
+	uint64_t rings_nb;
+} BuddyTraceFileHdr_t;
+
+typedef struct {
+	uint64_t ring_id;
+	uint64_t records_nb;
+} BuddyTraceRingHdr_t;
+
+struct BuddyTraceRing;
+struct BuddyTraceRing {
+	struct BuddyTraceRing* next;
+	uint64_t ring_id;
+	uint64_t head;
+	BuddyTraceRecord_t records[__BUDDY_TRACE_RING_SIZE];
+	uint32_t histogram[__BUDDY_TRACE_RANKS_NB][__BUDDY_TRACE_HIST_SIZE];
+};
+
+typedef struct BuddyTraceRing BuddyTraceRing_t;
+
+typedef struct {
+	uint64_t start;
+	uint32_t depth;
+	Rank_t rank;
+} BuddyTraceScope_t;
+
+
+// ====================================
+// = Private state.
+// ====================================
+// Weak definitions, so every translation unit including the header
+// shares the same registry and the same per-thread ring.
+__attribute__((weak)) BuddyTraceRing_t* __buddy_trace_rings = NULL;
+__attribute__((weak)) uint64_t __buddy_trace_rings_nb = 0;
+__attribute__((weak)) __thread BuddyTraceRing_t* __buddy_trace_ring = NULL;
+__attribute__((weak)) __thread uint32_t __buddy_trace_depth = 0;
+
+
+// ====================================
+// = Private methods.
+// ====================================
+
+static inline uint64_t __buddy_trace_now(void) {
+#if defined(__x86_64__) || defined(__i386__)
+	return __builtin_ia32_rdtsc();
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+static inline unsigned __buddy_trace_hist_bucket(const uint64_t value) {
+	unsigned result = (unsigned)value;
+	if(value >= __BUDDY_TRACE_HIST_SUB) {
+		const unsigned msb = 63u - (unsigned)__builtin_clzll(value);
+		const unsigned sub = (unsigned)(value >> (msb - __BUDDY_TRACE_HIST_SUB_BITS)) & (__BUDDY_TRACE_HIST_SUB - 1u);
+		result = (msb - __BUDDY_TRACE_HIST_SUB_BITS + 1u) * __BUDDY_TRACE_HIST_SUB + sub;
+	}
+	return result;
+}
+
+/**
+ * The lowest value which falls into the histogram bucket.
+ */
+static inline uint64_t __buddy_trace_hist_value(const unsigned bucket) {
+	uint64_t result = bucket;
+	if(bucket >= __BUDDY_TRACE_HIST_SUB) {
+		const unsigned msb = bucket / __BUDDY_TRACE_HIST_SUB + __BUDDY_TRACE_HIST_SUB_BITS - 1u;
+		const uint64_t sub = bucket % __BUDDY_TRACE_HIST_SUB;
+		result = (__BUDDY_TRACE_HIST_SUB + sub) << (msb - __BUDDY_TRACE_HIST_SUB_BITS);
+	}
+	return result;
+}
+
+/**
+ * Returns the ring of the calling thread, creates and registers it on the first call.
+ * May return NULL.
+ */
+static inline BuddyTraceRing_t* __buddy_trace_thread_ring(void) {
+	BuddyTraceRing_t* result = __buddy_trace_ring;
+	if(result == NULL) {
+		result = (BuddyTraceRing_t*)calloc(1, sizeof(*result));
+		if(result) {
+			result->ring_id = __atomic_fetch_add(&__buddy_trace_rings_nb, 1u, __ATOMIC_RELAXED);
+			result->next = __atomic_load_n(&__buddy_trace_rings, __ATOMIC_RELAXED);
+			while(!__atomic_compare_exchange_n(&__buddy_trace_rings, &result->next, result, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+			}
+			__buddy_trace_ring = result;
+		}
+	}
+	return result;
+}
+
+static inline BuddyTraceScope_t __buddy_trace_begin(const Rank_t rank) {
+	BuddyTraceScope_t result;
+	result.depth = __buddy_trace_depth;
+	result.rank = rank;
+	result.start = __buddy_trace_now();
+	return result;
+}
+
+static inline void __buddy_trace_end(const BuddyTraceScope_t* const scope, const BuddyTraceOp_t op, const size_t size) {
+	const uint64_t now = __buddy_trace_now();
+	BuddyTraceRing_t* const ring = __buddy_trace_thread_ring();
+	if(ring) {
+		const uint64_t cycles = now - scope->start;
+		const uint64_t head = ring->head;
+		BuddyTraceRecord_t* const record = ring->records + (head & (__BUDDY_TRACE_RING_SIZE - 1u));
+		record->timestamp = scope->start;
+		record->size = size;
+		record->cycles = cycles > UINT32_MAX ? UINT32_MAX : (uint32_t)cycles;
+		record->op = (uint8_t)op;
+		record->rank = scope->rank;
+		record->depth = (uint8_t)(__buddy_trace_depth - scope->depth);
+		record->reserved = 0;
+		__atomic_store_n(&ring->head, head + 1u, __ATOMIC_RELEASE);
+
+		if(scope->rank < __BUDDY_TRACE_RANKS_NB) {
+			__atomic_fetch_add(ring->histogram[scope->rank] + __buddy_trace_hist_bucket(cycles), 1u, __ATOMIC_RELAXED);
+		}
+	}
+}
+
+
+// ====================================
+// = Hooks.
+// ====================================
+#define __BUDDY_TRACE_BEGIN(rank) const BuddyTraceScope_t __buddy_trace_scope = __buddy_trace_begin(rank)
+#define __BUDDY_TRACE_STEP() (__buddy_trace_depth++)
+#define __BUDDY_TRACE_STEPS(nb) (__buddy_trace_depth += (nb))
+#define __BUDDY_TRACE_END(op, size) __buddy_trace_end(&__buddy_trace_scope, (op), (size))
+
+
+// ====================================
+// = Public methods.
+// ====================================
+
+/**
+* Sum the latency histograms of all the threads.
+* @param rank The granted rank.
+* @param histogram The output, __BUDDY_TRACE_HIST_SIZE counters. MUST NOT be null.
+* @return the total number of samples.
+*/
+static inline uint64_t buddy_trace_histogram(const Rank_t rank, uint64_t* const histogram) {
+	uint64_t result = 0;
+	memset(histogram, 0, sizeof(*histogram) * __BUDDY_TRACE_HIST_SIZE);
+	if(rank < __BUDDY_TRACE_RANKS_NB) {
+		const BuddyTraceRing_t* ring = __atomic_load_n(&__buddy_trace_rings, __ATOMIC_ACQUIRE);
+		while(ring) {
+			for(unsigned idx = 0; idx < __BUDDY_TRACE_HIST_SIZE; ++idx) {
+				const uint32_t count = __atomic_load_n(ring->histogram[rank] + idx, __ATOMIC_RELAXED);
+				histogram[idx] += count;
+				result += count;
+			}
+			ring = ring->next;
+		}
+	}
+	return result;
+}
+
+/**
+* Latency percentile of all the threads.
+* @param rank The granted rank.
+* @param percentile The percentile in the range [0, 100].
+* @return the lower bound in cycles of the bucket the percentile falls into, 0 if there are no samples.
+*/
+static inline uint64_t buddy_trace_percentile(const Rank_t rank, const double percentile) {
+	uint64_t histogram[__BUDDY_TRACE_HIST_SIZE];
+	const uint64_t total = buddy_trace_histogram(rank, histogram);
+	uint64_t result = 0;
+	if(total) {
+		const uint64_t threshold = (uint64_t)((double)total * percentile / 100.0);
+		uint64_t seen = 0;
+		for(unsigned idx = 0; idx < __BUDDY_TRACE_HIST_SIZE; ++idx) {
+			seen += histogram[idx];
+			if(histogram[idx] && seen >= threshold) {
+				result = __buddy_trace_hist_value(idx);
+				break;
+			}
+		}
+	}
+	return result;
+}
+
+/**
+* Write the records of all the threads in the binary dump format.
+* The records are lock-free copied, the ones overwritten while copying are skipped.
+* @param file The output file. MUST NOT be null.
+* @return zero on success.
+*/
+static inline int buddy_trace_dump(FILE* const file) {
+	int result = 0;
+	BuddyTraceRing_t* const rings = __atomic_load_n(&__buddy_trace_rings, __ATOMIC_ACQUIRE);
+	BuddyTraceRecord_t* const copy = (BuddyTraceRecord_t*)malloc(sizeof(BuddyTraceRecord_t) * __BUDDY_TRACE_RING_SIZE);
+
+	BuddyTraceFileHdr_t file_hdr;
+	memset(&file_hdr, 0, sizeof(file_hdr));
+	file_hdr.magic = __BUDDY_TRACE_MAGIC;
+	file_hdr.version = __BUDDY_TRACE_VERSION;
+	file_hdr.record_size = sizeof(BuddyTraceRecord_t);
+	for(const BuddyTraceRing_t* ring = rings; ring; ring = ring->next) {
+		file_hdr.rings_nb++;
+	}
+
+	if(copy == NULL || fwrite(&file_hdr, sizeof(file_hdr), 1, file) != 1) {
+		result = -1;
+	}
+
+	for(const BuddyTraceRing_t* ring = rings; result == 0 && ring; ring = ring->next) {
+		const uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+		const uint64_t first = head > __BUDDY_TRACE_RING_SIZE ? head - __BUDDY_TRACE_RING_SIZE : 0;
+		for(uint64_t idx = first; idx < head; ++idx) {
+			copy[idx - first] = ring->records[idx & (__BUDDY_TRACE_RING_SIZE - 1u)];
+		}
+
+		// The writer may have overwritten the oldest records meanwhile,
+		// and may be writing the slot of the record head_after - RING_SIZE.
+		const uint64_t head_after = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+		const uint64_t valid_first = head_after + 1u > __BUDDY_TRACE_RING_SIZE ? head_after + 1u - __BUDDY_TRACE_RING_SIZE : 0;
+		const uint64_t skip = valid_first > first ? (valid_first - first < head - first ? valid_first - first : head - first) : 0;
+
+		BuddyTraceRingHdr_t ring_hdr;
+		ring_hdr.ring_id = ring->ring_id;
+		ring_hdr.records_nb = head - first - skip;
+		if(fwrite(&ring_hdr, sizeof(ring_hdr), 1, file) != 1
+		   || fwrite(copy + skip, sizeof(BuddyTraceRecord_t), ring_hdr.records_nb, file) != ring_hdr.records_nb) {
+			result = -1;
+		}
+	}
+
+	free(copy);
+	return result;
+}
+
+#else // BUDDY_ALLOCATOR_TRACE
+
+#define __BUDDY_TRACE_BEGIN(rank)
+#define __BUDDY_TRACE_STEP() do {} while(0)
+#define __BUDDY_TRACE_STEPS(nb) do {} while(0)
+#define __BUDDY_TRACE_END(op, size) do {} while(0)
+
+#endif // BUDDY_ALLOCATOR_TRACE
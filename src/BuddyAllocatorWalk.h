@@ -0,0 +1,220 @@
+#pragma once
+
+#include "BuddyAllocator.h"
+
+// =========================================================
+// = Heap walk.
+//
+// Every chunk, busy or free, starts with a valid header, so the chunks
+// are enumerated in address order by hopping 2^rank bytes at a time.
+//
+// The walk is incremental: buddy_allocator_walk_step() visits a bounded
+// number of chunks and keeps the position in a cursor, so the caller may
+// release its lock between the steps. The allocator may change between
+// the steps, so the cursor holds a plain offset and every step starts
+// by locating the chunk which contains it. That is done top-down:
+//
+// region [base, base + 2^k) is either a single chunk (the header at base
+// has rank k) or is split into two halves, the first chunk of each half
+// starts at the half's base. So O(raw_rank - RANK_MIN) headers are read.
+//
+// A chunk which was merged or split between two steps is visited as it
+// is at the moment of the next step, so the report is a close estimate
+// under concurrent use and an exact one otherwise.
+// =========================================================
+
+
+// ====================================
+// = Types definitions.
+// ====================================
+typedef struct {
+	size_t offset;
+} BuddyWalkCursor_t;
+
+typedef struct {
+	void* user_ptr;
+	size_t offset;
+	Rank_t rank;
+	bool busy;
+} BuddyWalkChunk_t;
+
+/**
+ * Called for every chunk visited.
+ * @return false to stop the walk.
+ */
+typedef bool (*BuddyWalkCallback_t)(void* ctx, const BuddyWalkChunk_t* chunk);
+
+typedef struct {
+	size_t busy_nb[__BUDDY_ALLOCATOR_RANK_RANGE + 1u];
+	size_t free_nb[__BUDDY_ALLOCATOR_RANK_RANGE + 1u];
+	size_t busy_bytes;
+	size_t free_bytes;
+	size_t chunks_nb;
+} BuddyWalkReport_t;
+
+
+// ====================================
+// = Private methods.
+// ====================================
+
+/**
+ * Finds the chunk containing the offset.
+ */
+static inline size_t __buddy_allocator_walk_locate(const BuddyAllocator_t* const ins, const size_t offset) {
+	const uint8_t* const raw_mem_u8ptr = (const uint8_t*)(ins->raw_memory_ptr);
+	size_t base = 0;
+	Rank_t rank = ins->raw_memory_rank;
+	while(((const ChunkHdr_t*)(raw_mem_u8ptr + base))->rank < rank) {
+		rank--;
+		if(offset & (1ull << rank)) {
+			base |= 1ull << rank;
+		}
+	}
+	return base;
+}
+
+static inline bool __buddy_allocator_report_chunk(void* ctx, const BuddyWalkChunk_t* chunk) {
+	BuddyWalkReport_t* const report = (BuddyWalkReport_t*)ctx;
+	const size_t size = 1ull << chunk->rank;
+	const Rank_t bucket = chunk->rank - __BUDDY_ALLOCATOR_RANK_MIN;
+	if(chunk->busy) {
+		report->busy_nb[bucket]++;
+		report->busy_bytes += size;
+	} else {
+		report->free_nb[bucket]++;
+		report->free_bytes += size;
+	}
+	report->chunks_nb++;
+	return true;
+}
+
+
+// ====================================
+// = Public methods.
+// ====================================
+
+/**
+* Start a new walk.
+* @param cursor The cursor to initialize. MUST NOT be null.
+*/
+static inline void buddy_allocator_walk_begin(BuddyWalkCursor_t* const cursor) {
+	cursor->offset = 0;
+}
+
+/**
+* @param ins The buddy allocator instance pointer. MUST NOT be null.
+* @param cursor The cursor. MUST NOT be null.
+* @return true if all the chunks have been visited.
+*/
+static inline bool buddy_allocator_walk_done(const BuddyAllocator_t* const ins, const BuddyWalkCursor_t* const cursor) {
+	return cursor->offset >= (1ull << ins->raw_memory_rank);
+}
+
+/**
+* Visit up to @a chunks_max chunks starting from the cursor position.
+* The caller MUST hold exclusive access to the allocator during the call only.
+* @param ins The buddy allocator instance pointer. MUST NOT be null.
+* @param cursor The cursor. MUST NOT be null.
+* @param chunks_max The maximum number of chunks to visit.
+* @param callback The visitor. MUST NOT be null.
+* @param ctx The visitor context.
+* @return the number of chunks visited.
+*/
+static inline size_t buddy_allocator_walk_step(
+	const BuddyAllocator_t* const ins,
+	BuddyWalkCursor_t* const cursor,
+	const size_t chunks_max,
+	BuddyWalkCallback_t callback,
+	void* ctx
+                                              ) {
+	size_t result = 0;
+	uint8_t* const raw_mem_u8ptr = (uint8_t*)(ins->raw_memory_ptr);
+
+	if(!buddy_allocator_walk_done(ins, cursor)) {
+		size_t offset = __buddy_allocator_walk_locate(ins, cursor->offset);
+		if(offset != cursor->offset) {
+			// The cursor chunk was merged into a chunk which has been visited already.
+			ChunkHdr_t* const container = (ChunkHdr_t*)(raw_mem_u8ptr + offset);
+			offset += 1ull << container->rank;
+		}
+
+		bool proceed = true;
+		while(proceed && result < chunks_max && offset < (1ull << ins->raw_memory_rank)) {
+			ChunkHdr_t* const chunk = (ChunkHdr_t*)(raw_mem_u8ptr + offset);
+			BuddyWalkChunk_t info;
+			info.user_ptr = __buddy_allocator_user_ptr(chunk);
+			info.offset = offset;
+			info.rank = chunk->rank;
+			info.busy = chunk->busy;
+
+			offset += 1ull << chunk->rank;
+			result++;
+			proceed = callback(ctx, &info);
+		}
+		cursor->offset = proceed ? offset : (1ull << ins->raw_memory_rank);
+	}
+	return result;
+}
+
+/**
+* Visit all the chunks at once.
+* @param ins The buddy allocator instance pointer. MUST NOT be null.
+* @param callback The visitor. MUST NOT be null.
+* @param ctx The visitor context.
+* @return the number of chunks visited.
+*/
+static inline size_t buddy_allocator_walk(const BuddyAllocator_t* const ins, BuddyWalkCallback_t callback, void* ctx) {
+	BuddyWalkCursor_t cursor;
+	buddy_allocator_walk_begin(&cursor);
+	return buddy_allocator_walk_step(ins, &cursor, SIZE_MAX, callback, ctx);
+}
+
+/**
+* Reset a usage report before the walk.
+* @param report The report. MUST NOT be null.
+*/
+static inline void buddy_allocator_report_begin(BuddyWalkReport_t* const report) {
+	memset(report, 0, sizeof(*report));
+}
+
+/**
+* Account up to @a chunks_max chunks in the usage report.
+* The caller MUST hold exclusive access to the allocator during the call only.
+* @param ins The buddy allocator instance pointer. MUST NOT be null.
+* @param cursor The cursor. MUST NOT be null.
+* @param chunks_max The maximum number of chunks to visit.
+* @param report The report. MUST NOT be null.
+* @return true if the report is complete.
+*/
+static inline bool buddy_allocator_report_step(
+	const BuddyAllocator_t* const ins,
+	BuddyWalkCursor_t* const cursor,
+	const size_t chunks_max,
+	BuddyWalkReport_t* const report
+                                              ) {
+	buddy_allocator_walk_step(ins, cursor, chunks_max, __buddy_allocator_report_chunk, report);
+	return buddy_allocator_walk_done(ins, cursor);
+}
+
+/**
+* Print the usage report grouping the live bytes by rank.
+* @param report The report. MUST NOT be null.
+* @param file The output file. MUST NOT be null.
+*/
+static inline void buddy_allocator_report_print(const BuddyWalkReport_t* const report, FILE* const file) {
+	fprintf(file, "==== Buddy Allocator usage report ====\n");
+	fprintf(file, "Chunks     : %zu\n", report->chunks_nb);
+	fprintf(file, "Live bytes : %zu\n", report->busy_bytes);
+	fprintf(file, "Free bytes : %zu\n", report->free_bytes);
+
+	for(Rank_t bucket = 0; bucket <= __BUDDY_ALLOCATOR_RANK_RANGE; ++bucket) {
+		if(report->busy_nb[bucket] || report->free_nb[bucket]) {
+			const Rank_t rank = bucket + __BUDDY_ALLOCATOR_RANK_MIN;
+			const size_t size = 1ull << rank;
+			fprintf(file, "[ Rank=%-2u", rank);
+			fprintf(file, "  Size=%-10zu ] :", size);
+			fprintf(file, " live %zu (%zu bytes)", report->busy_nb[bucket], report->busy_nb[bucket] * size);
+			fprintf(file, " free %zu (%zu bytes)\n", report->free_nb[bucket], report->free_nb[bucket] * size);
+		}
+	}
+}
@@ -0,0 +1,275 @@
+#pragma once
+
+#include "BuddyAllocator.h"
+
+// =========================================================
+// = Fixed size object pool over a buddy allocator.
+//
+// The pool grabs whole high rank chunks (slabs) from the buddy allocator
+// and cuts them into equal slots. Free slots are linked through their
+// first word, so a slot costs no memory besides itself.
+//
+// = slab layout
+//
+// | < ------------------- (2^slab_rank) bytes ------------------- > |
+//
+// [ ChunkHeader_t ][ BuddyPoolSlab_t ][ pad ][ slot ][ slot ] ... [ ]
+// |                                          |
+// Chunk ptr                                  Slab first slot ptr
+//
+// Every buddy chunk is aligned to its size relative to raw_memory_ptr,
+// so the slab of any slot is found by masking the slot offset:
+//
+// slab(slot) = raw + ((slot - raw) & ~(2^slab_rank - 1)) + sizeof(ChunkHeader_t)
+//
+// The slabs having at least one free slot are kept in the partial list,
+// the exhausted ones in the full list. A slab which becomes empty is
+// returned to the buddy allocator unless it is the only partial slab.
+// =========================================================
+
+
+// ====================================
+// = Types definitions.
+// ====================================
+struct BuddyPoolSlot;
+struct BuddyPoolSlot {
+	struct BuddyPoolSlot* next;
+};
+
+typedef struct BuddyPoolSlot BuddyPoolSlot_t;
+
+struct BuddyPoolSlab;
+struct BuddyPoolSlab {
+	struct BuddyPoolSlab* prev;
+	struct BuddyPoolSlab* next;
+	BuddyPoolSlot_t* free_head;
+	uint8_t* unused_ptr; // The slots behind this pointer have never been used.
+	size_t used_nb;
+};
+
+typedef struct BuddyPoolSlab BuddyPoolSlab_t;
+
+
+// ====================================
+// = Static configuration.
+// ====================================
+#define __BUDDY_POOL_SLAB_SLOTS_MIN (size_t)(64)
+
+
+typedef struct {
+	BuddyAllocator_t* ba;
+	BuddyPoolSlab_t* partial;
+	BuddyPoolSlab_t* full;
+	size_t obj_size;
+	size_t align;
+	size_t slots_nb;
+	size_t slabs_nb;
+	Rank_t slab_rank;
+} BuddyPool_t;
+
+/**
+ * Create a pool of the given type.
+ * The alignment is taken from the type.
+ */
+#define buddy_pool_create_typed(ba, type) \
+	buddy_pool_create((ba), sizeof(type), __alignof__(type))
+
+
+// ====================================
+// = Private methods.
+// ====================================
+
+static inline void __buddy_pool_list_push(BuddyPoolSlab_t** const head, BuddyPoolSlab_t* const slab) {
+	slab->prev = NULL;
+	slab->next = *head;
+	if(*head) {
+		(*head)->prev = slab;
+	}
+	*head = slab;
+}
+
+static inline void __buddy_pool_list_remove(BuddyPoolSlab_t** const head, BuddyPoolSlab_t* const slab) {
+	if(slab->prev) {
+		slab->prev->next = slab->next;
+	} else {
+		*head = slab->next;
+	}
+	if(slab->next) {
+		slab->next->prev = slab->prev;
+	}
+}
+
+/**
+ * Translates a slot pointer to its slab.
+ */
+static inline BuddyPoolSlab_t* __buddy_pool_slab(const BuddyPool_t* const pool, const void* const slot) {
+	const uint8_t* const raw_mem_u8ptr = (const uint8_t*)(pool->ba->raw_memory_ptr);
+	const size_t offset = ((const uint8_t*)slot - raw_mem_u8ptr) & ~((1ull << pool->slab_rank) - 1u);
+	return (BuddyPoolSlab_t*)(raw_mem_u8ptr + offset + sizeof(ChunkHdr_t));
+}
+
+/**
+ * Grabs a new slab from the buddy allocator and attaches it to the partial list.
+ * May return NULL.
+ */
+static inline BuddyPoolSlab_t* __buddy_pool_slab_create(BuddyPool_t* const pool) {
+	const size_t chunk_size = 1ull << pool->slab_rank;
+	BuddyPoolSlab_t* const slab = (BuddyPoolSlab_t*)buddy_allocator_alloc(pool->ba, chunk_size - sizeof(ChunkHdr_t));
+	if(slab) {
+		const uintptr_t first = ((uintptr_t)(slab + 1) + pool->align - 1u) & ~(uintptr_t)(pool->align - 1u);
+		slab->free_head = NULL;
+		slab->unused_ptr = (uint8_t*)first;
+		slab->used_nb = 0;
+		__buddy_pool_list_push(&pool->partial, slab);
+		pool->slabs_nb++;
+	}
+	return slab;
+}
+
+/**
+ * Detaches an empty slab from the partial list and returns it to the buddy allocator.
+ */
+static inline void __buddy_pool_slab_release(BuddyPool_t* const pool, BuddyPoolSlab_t* const slab) {
+	__buddy_pool_list_remove(&pool->partial, slab);
+	buddy_allocator_free(pool->ba, slab);
+	pool->slabs_nb--;
+}
+
+
+// ====================================
+// = Public methods.
+// ====================================
+
+/**
+* Create an object pool.
+* @param ba The buddy allocator to grab the slabs from. MUST NOT be null.
+* @param obj_size The object size. MUST NOT be zero.
+* @param align The object alignment. MUST BE a power of two value.
+* @return the new pool pointer or NULL in case of any errors.
+*/
+static inline BuddyPool_t* buddy_pool_create(BuddyAllocator_t* const ba, size_t obj_size, size_t align) {
+	BuddyPool_t* result = NULL;
+
+	if(obj_size && __buddy_allocator_is_po2(align)) {
+		if(align < sizeof(BuddyPoolSlot_t)) {
+			align = sizeof(BuddyPoolSlot_t);
+		}
+		if(obj_size < sizeof(BuddyPoolSlot_t)) {
+			obj_size = sizeof(BuddyPoolSlot_t);
+		}
+		obj_size = (obj_size + align - 1u) & ~(align - 1u);
+
+		// The worst case padding is reserved, so every slab holds the same number of slots.
+		const size_t overhead = sizeof(ChunkHdr_t) + sizeof(BuddyPoolSlab_t) + align - 1u;
+		Rank_t slab_rank = __buddy_allocator_rank(overhead + obj_size * __BUDDY_POOL_SLAB_SLOTS_MIN);
+		if(slab_rank < __BUDDY_ALLOCATOR_RANK_MIN) {
+			slab_rank = __BUDDY_ALLOCATOR_RANK_MIN;
+		}
+		if(slab_rank > ba->raw_memory_rank) {
+			slab_rank = ba->raw_memory_rank;
+		}
+
+		const size_t slab_size = 1ull << slab_rank;
+		if(slab_size > overhead + obj_size) {
+			result = (BuddyPool_t*)malloc(sizeof(*result));
+
+			if(result) {
+				memset(result, 0, sizeof(*result));
+				result->ba = ba;
+				result->obj_size = obj_size;
+				result->align = align;
+				result->slab_rank = slab_rank;
+				result->slots_nb = (slab_size - overhead) / obj_size;
+			}
+		}
+	}
+	return result;
+}
+
+/**
+* Destroy an object pool.
+* All the slabs are returned to the buddy allocator, the objects still in use become invalid.
+* @param pool The pool instance pointer. MUST NOT be null.
+*/
+static inline void buddy_pool_destroy(BuddyPool_t* const pool) {
+	BuddyPoolSlab_t* lists[] = {pool->partial, pool->full};
+	for(size_t idx = 0; idx < sizeof(lists) / sizeof(lists[0]); ++idx) {
+		BuddyPoolSlab_t* slab = lists[idx];
+		while(slab) {
+			BuddyPoolSlab_t* const next = slab->next;
+			buddy_allocator_free(pool->ba, slab);
+			slab = next;
+		}
+	}
+	free(pool);
+}
+
+/**
+* Get an object from the pool.
+* The object memory is not initialized.
+* @param pool The pool instance pointer. MUST NOT be null.
+* @return pointer to the object, or @a NULL if out of memory
+*/
+static inline void* buddy_pool_get(BuddyPool_t* const pool) {
+	BuddyPoolSlab_t* slab = pool->partial;
+	if(slab == NULL) {
+		slab = __buddy_pool_slab_create(pool);
+	}
+
+	void* result = NULL;
+	if(slab) {
+		result = slab->free_head;
+		if(result) {
+			slab->free_head = slab->free_head->next;
+		} else {
+			result = slab->unused_ptr;
+			slab->unused_ptr += pool->obj_size;
+		}
+
+		if(++(slab->used_nb) == pool->slots_nb) {
+			__buddy_pool_list_remove(&pool->partial, slab);
+			__buddy_pool_list_push(&pool->full, slab);
+		}
+	}
+	return result;
+}
+
+/**
+* Put an object back to the pool.
+* If @a obj is @a NULL , it simply returns
+* @param pool The pool instance pointer. MUST NOT be null.
+* @param obj The object previously got from the same pool.
+*/
+static inline void buddy_pool_put(BuddyPool_t* const pool, void* const obj) {
+	if(obj) {
+		BuddyPoolSlab_t* const slab = __buddy_pool_slab(pool, obj);
+		BuddyPoolSlot_t* const slot = (BuddyPoolSlot_t*)obj;
+		slot->next = slab->free_head;
+		slab->free_head = slot;
+
+		if((slab->used_nb)-- == pool->slots_nb) {
+			__buddy_pool_list_remove(&pool->full, slab);
+			__buddy_pool_list_push(&pool->partial, slab);
+		}
+
+		// Keep the only partial slab to avoid thrashing the buddy allocator on get/put cycles.
+		if(slab->used_nb == 0 && (slab->prev || slab->next)) {
+			__buddy_pool_slab_release(pool, slab);
+		}
+	}
+}
+
+/**
+* Return all the empty slabs to the buddy allocator.
+* @param pool The pool instance pointer. MUST NOT be null.
+*/
+static inline void buddy_pool_shrink(BuddyPool_t* const pool) {
+	BuddyPoolSlab_t* slab = pool->partial;
+	while(slab) {
+		BuddyPoolSlab_t* const next = slab->next;
+		if(slab->used_nb == 0) {
+			__buddy_pool_slab_release(pool, slab);
+		}
+		slab = next;
+	}
+}
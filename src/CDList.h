@@ -0,0 +1,174 @@
+#pragma once
+
+#include <memory.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+// ====================================
+// = Types definitions.
+// ====================================
+
+/**
+ * An intrusive way implemented circular doubly linked list with a sentinel node.
+ *
+ * The sentinel is linked in place of NULL, so an empty list points to itself
+ * and every node always has both neighbours. No operation but the pops checks
+ * for the list boundaries, and unlinking a node does not need the list at all.
+ *
+ * The intrusive CDListNode_t contract:
+ * CDListNode_t structure MUST BE defined before including this header file.
+ * CDListNode_t structure MUST HAVE the following fields:
+ * CDListNode_t* prev;
+ * CDListNode_t* next;
+ *
+ * The list points to itself, so a CDList_t instance MUST NOT be moved or copied after cdlist_init().
+ */
+typedef struct {
+	CDListNode_t sentinel;
+} CDList_t;
+
+
+// ====================================
+// = Private methods.
+// ====================================
+
+static inline void __cdlist_link(CDListNode_t* const prev, CDListNode_t* const next, CDListNode_t* const node) {
+	node->prev = prev;
+	node->next = next;
+	prev->next = node;
+	next->prev = node;
+}
+
+static inline void __cdlist_unlink(CDListNode_t* const node) {
+	node->prev->next = node->next;
+	node->next->prev = node->prev;
+}
+
+
+// ====================================
+// = Public methods.
+// ====================================
+
+/**
+ * Initialize the CDList structure instance.
+ * @param ins - must not be NULL.
+ */
+static inline void cdlist_init(CDList_t* const ins) {
+	ins->sentinel.prev = &ins->sentinel;
+	ins->sentinel.next = &ins->sentinel;
+}
+
+/**
+ * The end of an iteration, the nodes are visited by:
+ * for(node = cdlist_end(ins)->next; node != cdlist_end(ins); node = node->next)
+ * @param ins - must not be NULL.
+ */
+static inline CDListNode_t* cdlist_end(CDList_t* const ins) {
+	return &ins->sentinel;
+}
+
+/**
+ * Attach a new node to the head of the list.
+ * @param ins - must not be NULL.
+ * @param node - must not be attached to any lists before the calling.
+ */
+static inline void cdlist_push_front(CDList_t* const ins, CDListNode_t* const node) {
+	__cdlist_link(&ins->sentinel, ins->sentinel.next, node);
+}
+
+/**
+ * Attach a new node to the tail of the list.
+ * @param ins - must not be NULL.
+ * @param node - must not be attached to any lists before the calling.
+ */
+static inline void cdlist_push_back(CDList_t* const ins, CDListNode_t* const node) {
+	__cdlist_link(ins->sentinel.prev, &ins->sentinel, node);
+}
+
+/**
+ * Detach the head node of the list.
+ * @param ins - must not be NULL.
+ * @return - a pointer of the detached node or NULL in case of the list is empty.
+ */
+static inline CDListNode_t* cdlist_pop_front(CDList_t* const ins) {
+	CDListNode_t* result = ins->sentinel.next;
+	if(result != &ins->sentinel) {
+		__cdlist_unlink(result);
+	} else {
+		result = NULL;
+	}
+	return result;
+}
+
+/**
+ * Detach the tail node of the list.
+ * @param ins - must not be NULL.
+ * @return - a pointer of the detached node or NULL in case of the list is empty.
+ */
+static inline CDListNode_t* cdlist_pop_back(CDList_t* const ins) {
+	CDListNode_t* result = ins->sentinel.prev;
+	if(result != &ins->sentinel) {
+		__cdlist_unlink(result);
+	} else {
+		result = NULL;
+	}
+	return result;
+}
+
+/**
+ * Attach @node just before node @before in the list.
+ * @param before - must be attached to a list.
+ * @param node - must not be attached to any lists before the calling.
+ */
+static inline void cdlist_push_before(CDListNode_t* const before, CDListNode_t* const node) {
+	__cdlist_link(before->prev, before, node);
+}
+
+/**
+ * Attach @node just after node @after in the list.
+ * @param after - must be attached to a list.
+ * @param node - must not be attached to any lists before the calling.
+ */
+static inline void cdlist_push_after(CDListNode_t* const after, CDListNode_t* const node) {
+	__cdlist_link(after, after->next, node);
+}
+
+/**
+ * Detach the given node from whichever list it is attached to.
+ * @param node - must be attached to a list before the calling.
+ */
+static inline void cdlist_remove(CDListNode_t* const node) {
+	__cdlist_unlink(node);
+}
+
+/**
+ * Unlink all the nodes which the list contains.
+ * @param ins - must not be NULL.
+ */
+static inline void cdlist_reset(CDList_t* const ins) {
+	cdlist_init(ins);
+}
+
+/**
+ * Check if the list is empty.
+ * @param ins - must not be NULL.
+ * @return non zero value in case empty list.
+ */
+static inline int cdlist_empty(const CDList_t* const ins) {
+	return (ins->sentinel.next == &ins->sentinel);
+}
+
+/**
+ * Calculate the number of nodes the list contains.
+ * Warning: the time complexity of the method is O(N), where N is a number of nodes.
+ * @param ins - must not be NULL.
+ */
+static inline size_t cdlist_size(const CDList_t* const ins) {
+	const CDListNode_t* head = ins->sentinel.next;
+	size_t result = 0;
+	while(head != &ins->sentinel) {
+		result++;
+		head = head->next;
+	}
+	return result;
+}
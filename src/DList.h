@@ -95,7 +95,7 @@ static inline void __dlist_unlink(DListNode_t* const node) {
  * Initialize the DList structure instance.
  * @param ins - must not be NULL.
  */
-void dlist_init(DList_t* const ins) {
+static inline void dlist_init(DList_t* const ins) {
 	if(ins) {
 		memset(ins, 0, sizeof(*ins));
 	}
@@ -106,7 +106,7 @@ void dlist_init(DList_t* const ins) {
  * @param ins - must not be NULL.
  * @param node - must not be attached to any lists before the calling.
  */
-void dlist_push_front(DList_t* const ins, DListNode_t* const node) {
+static inline void dlist_push_front(DList_t* const ins, DListNode_t* const node) {
 	if(ins->head) {
 		__dlist_link_head(ins, node);
 	} else {
@@ -119,7 +119,7 @@ void dlist_push_front(DList_t* const ins, DListNode_t* const node) {
  * @param ins - must not be NULL.
  * @param node - must not be attached to the list before the calling.
  */
-void dlist_push_back(DList_t* const ins, DListNode_t* const node) {
+static inline void dlist_push_back(DList_t* const ins, DListNode_t* const node) {
 	if(ins->tail) {
 		__dlist_link_tail(ins, node);
 	} else {
@@ -132,7 +132,7 @@ void dlist_push_back(DList_t* const ins, DListNode_t* const node) {
  * @param ins - must not be NULL.
  * @return - a pointer of the detached node or NULL in case of the list is empty.
  */
-DListNode_t* dlist_pop_front(DList_t* const ins) {
+static inline DListNode_t* dlist_pop_front(DList_t* const ins) {
 	DListNode_t* result = NULL;
 	if(ins->head != ins->tail) {
 		result = __dlist_unlink_head(ins);
@@ -147,7 +147,7 @@ DListNode_t* dlist_pop_front(DList_t* const ins) {
  * @param ins - must not be NULL.
  * @return - a pointer of the detached node or NULL in case of the list is empty.
  */
-DListNode_t* dlist_pop_back(DList_t* const ins) {
+static inline DListNode_t* dlist_pop_back(DList_t* const ins) {
 	DListNode_t* result = NULL;
 	if(ins->head != ins->tail) {
 		result = __dlist_unlink_tail(ins);
@@ -163,7 +163,7 @@ DListNode_t* dlist_pop_back(DList_t* const ins) {
  * @param before - must be attached to the list.
  * @param node - must not be attached to the list before the calling.
  */
-void dlist_push_before(DList_t* const ins, DListNode_t* const before, DListNode_t* const node) {
+static inline void dlist_push_before(DList_t* const ins, DListNode_t* const before, DListNode_t* const node) {
 	if(before == ins->head) {
 		__dlist_link_head(ins, node);
 	} else {
@@ -177,7 +177,7 @@ void dlist_push_before(DList_t* const ins, DListNode_t* const before, DListNode_
  * @param after - must be attached to the list.
  * @param node - must not be attached to the list before the calling.
  */
-void dlist_push_after(DList_t* const ins, DListNode_t* const after, DListNode_t* const node) {
+static inline void dlist_push_after(DList_t* const ins, DListNode_t* const after, DListNode_t* const node) {
 	if(after == ins->tail) {
 		__dlist_link_tail(ins, node);
 	} else {
@@ -190,7 +190,7 @@ void dlist_push_after(DList_t* const ins, DListNode_t* const after, DListNode_t*
  * @param ins - must not be NULL.
  * @param node - must be attached to the list before the calling.
  */
-void dlist_remove(DList_t* const ins, DListNode_t* const node) {
+static inline void dlist_remove(DList_t* const ins, DListNode_t* const node) {
 	if(ins->head) {
 		if(node == ins->head) {
 			dlist_pop_front(ins);
@@ -206,7 +206,7 @@ void dlist_remove(DList_t* const ins, DListNode_t* const node) {
  * Unlink all the nodes which the list contains.
  * @param ins - must not be NULL.
  */
-void dlist_reset(DList_t* const ins) {
+static inline void dlist_reset(DList_t* const ins) {
 	ins->head = NULL;
 	ins->tail = NULL;
 }
@@ -216,7 +216,7 @@ void dlist_reset(DList_t* const ins) {
  * @param ins - must not be NULL.
  * @return non zero value in case empty list.
  */
-int dlist_empty(DList_t* const ins) {
+static inline int dlist_empty(DList_t* const ins) {
 	return (ins->head == NULL);
 }
 
@@ -225,7 +225,7 @@ int dlist_empty(DList_t* const ins) {
  * Warning: the time complexity of the method is O(N), where N is a number of nodes.
  * @param ins - must not be NULL.
  */
-size_t dlist_size(const DList_t* const ins) {
+static inline size_t dlist_size(const DList_t* const ins) {
 	const DListNode_t* head = ins->head;
 	size_t result = 0;
 	while(head) {
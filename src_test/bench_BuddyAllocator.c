@@ -0,0 +1,297 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "../src/BuddyAllocator.h"
+
+// =========================================================
+// = Buddy allocator per operation cost.
+//
+// - alloc + free of a minimal chunk on an empty arena: the whole split
+//   chain down from the top chunk and the whole merge chain back up,
+// - the same free alone, when the chunk headers are no longer cached,
+// - the same with a half of the arena busy, so the merge chain is walked
+//   over cold headers instead of the last busy chunk fast path,
+// - alloc + free of the whole capacity,
+// - alloc + free of a half of the capacity,
+// - random alloc / free pairs over a fragmented arena.
+//
+// Every scenario is run a few times and the best run is reported.
+// The counter is the TSC on x86 and nanoseconds elsewhere. The hardware
+// counters are read with perf_event_open(2) on Linux, user space only;
+// they are reported as "-" when they are not available, e.g. in a VM or
+// with kernel.perf_event_paranoid > 2.
+//
+// bench_buddy_allocator_prefetch is the same with BUDDY_ALLOCATOR_PREFETCH.
+// =========================================================
+
+#define __BENCH_BA_MEM_RANK (Rank_t)(30)
+#define __BENCH_BA_MEM_CAPACITY (size_t)(1ull << __BENCH_BA_MEM_RANK)
+#define __BENCH_BA_ROUNDS (size_t)(200000)
+#define __BENCH_BA_LIVE_NB (size_t)(4096)
+#define __BENCH_BA_REPEATS_NB (size_t)(5)
+#define __BENCH_BA_COLD_ROUNDS (size_t)(200)
+#define __BENCH_BA_EVICT_SIZE (size_t)(64u << 20)
+#define __BENCH_BA_EVENTS_NB (size_t)(4)
+
+typedef struct {
+	const char* name;
+	uint32_t type;
+	uint64_t config;
+} BenchEvent_t;
+
+/**
+ * Ticks and hardware counters accumulated over the measured regions of a run.
+ */
+typedef struct {
+	uint64_t begin;
+	uint64_t ticks;
+	uint64_t counts[__BENCH_BA_EVENTS_NB];
+	size_t ops_nb;
+} BenchProbe_t;
+
+#if defined(__linux__)
+static const BenchEvent_t events[__BENCH_BA_EVENTS_NB] = {
+	{"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+	{"instr", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+	{"L1D-miss", PERF_TYPE_HW_CACHE,
+	 PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+	{"LLC-miss", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+};
+#else
+static const BenchEvent_t events[__BENCH_BA_EVENTS_NB] = {
+	{"cycles", 0, 0}, {"instr", 0, 0}, {"L1D-miss", 0, 0}, {"LLC-miss", 0, 0},
+};
+#endif
+
+static int event_fds[__BENCH_BA_EVENTS_NB];
+
+/**
+ * Opens every counter which is available.
+ * @return the number of counters opened.
+ */
+static size_t __bench_events_open() {
+	size_t result = 0;
+	for(size_t idx = 0; idx < __BENCH_BA_EVENTS_NB; ++idx) {
+		event_fds[idx] = -1;
+#if defined(__linux__)
+		struct perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = events[idx].type;
+		attr.config = events[idx].config;
+		attr.disabled = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		event_fds[idx] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+		if(event_fds[idx] >= 0) {
+			result++;
+		}
+#endif
+	}
+	return result;
+}
+
+static void __bench_events_close() {
+	for(size_t idx = 0; idx < __BENCH_BA_EVENTS_NB; ++idx) {
+#if defined(__linux__)
+		if(event_fds[idx] >= 0) {
+			close(event_fds[idx]);
+		}
+#endif
+		event_fds[idx] = -1;
+	}
+}
+
+static inline uint64_t __bench_now() {
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+static inline void __bench_begin(BenchProbe_t* const probe) {
+#if defined(__linux__)
+	for(size_t idx = 0; idx < __BENCH_BA_EVENTS_NB; ++idx) {
+		if(event_fds[idx] >= 0) {
+			ioctl(event_fds[idx], PERF_EVENT_IOC_RESET, 0);
+			ioctl(event_fds[idx], PERF_EVENT_IOC_ENABLE, 0);
+		}
+	}
+#endif
+	probe->begin = __bench_now();
+}
+
+static inline void __bench_end(BenchProbe_t* const probe, const size_t ops_nb) {
+	probe->ticks += __bench_now() - probe->begin;
+	probe->ops_nb += ops_nb;
+#if defined(__linux__)
+	for(size_t idx = 0; idx < __BENCH_BA_EVENTS_NB; ++idx) {
+		if(event_fds[idx] >= 0) {
+			ioctl(event_fds[idx], PERF_EVENT_IOC_DISABLE, 0);
+			uint64_t count = 0;
+			if(read(event_fds[idx], &count, sizeof(count)) == (ssize_t)sizeof(count)) {
+				probe->counts[idx] += count;
+			}
+		}
+	}
+#endif
+}
+
+static inline uint32_t __bench_random(uint32_t* const state) {
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+	return *state;
+}
+
+/**
+ * Measures alloc + free pairs of the size.
+ */
+static BenchProbe_t __bench_pair(BuddyAllocator_t* ba, const size_t size) {
+	BenchProbe_t probe = {0};
+	__bench_begin(&probe);
+	for(size_t round = 0; round < __BENCH_BA_ROUNDS; ++round) {
+		void* ptr = buddy_allocator_alloc(ba, size);
+		if(ptr == NULL) {
+			abort();
+		}
+		buddy_allocator_free(ba, ptr);
+	}
+	__bench_end(&probe, __BENCH_BA_ROUNDS);
+	return probe;
+}
+
+/**
+ * Measures the free of a minimal chunk alone.
+ * The caches are flushed by a walk over a large buffer between the alloc and the free.
+ * @param pinned_size The size of a chunk kept busy meanwhile, zero for none.
+ */
+static BenchProbe_t __bench_cold_free(BuddyAllocator_t* ba, uint8_t* const evict, const size_t pinned_size) {
+	BenchProbe_t probe = {0};
+	void* const pinned = pinned_size ? buddy_allocator_alloc(ba, pinned_size) : NULL;
+	for(size_t round = 0; round < __BENCH_BA_COLD_ROUNDS; ++round) {
+		void* ptr = buddy_allocator_alloc(ba, 1);
+		if(ptr == NULL) {
+			abort();
+		}
+		for(size_t offset = 0; offset < __BENCH_BA_EVICT_SIZE; offset += 64u) {
+			evict[offset]++;
+		}
+		__bench_begin(&probe);
+		buddy_allocator_free(ba, ptr);
+		__bench_end(&probe, 1);
+	}
+	buddy_allocator_free(ba, pinned);
+	return probe;
+}
+
+/**
+ * Measures random alloc + free pairs over a fragmented arena.
+ */
+static BenchProbe_t __bench_random_pairs(BuddyAllocator_t* ba) {
+	BenchProbe_t probe = {0};
+	static void* live[__BENCH_BA_LIVE_NB];
+	uint32_t state = 2463534242u;
+	for(size_t i = 0; i < __BENCH_BA_LIVE_NB; ++i) {
+		live[i] = buddy_allocator_alloc(ba, 1ull << (__bench_random(&state) % 17u));
+	}
+
+	__bench_begin(&probe);
+	for(size_t round = 0; round < __BENCH_BA_ROUNDS; ++round) {
+		const size_t idx = __bench_random(&state) % __BENCH_BA_LIVE_NB;
+		buddy_allocator_free(ba, live[idx]);
+		live[idx] = buddy_allocator_alloc(ba, 1ull << (__bench_random(&state) % 17u));
+	}
+	__bench_end(&probe, __BENCH_BA_ROUNDS);
+
+	for(size_t i = 0; i < __BENCH_BA_LIVE_NB; ++i) {
+		buddy_allocator_free(ba, live[i]);
+	}
+	return probe;
+}
+
+static void __bench_keep_best(BenchProbe_t* const best, const BenchProbe_t probe) {
+	if(best->ops_nb == 0 || probe.ticks * best->ops_nb < best->ticks * probe.ops_nb) {
+		*best = probe;
+	}
+}
+
+static void __bench_print(const char* const name, const BenchProbe_t* const probe) {
+	printf("%-28s %10.2f", name, (double)probe->ticks / (double)probe->ops_nb);
+	for(size_t idx = 0; idx < __BENCH_BA_EVENTS_NB; ++idx) {
+		if(event_fds[idx] >= 0) {
+			printf(" %10.2f", (double)probe->counts[idx] / (double)probe->ops_nb);
+		} else {
+			printf(" %10s", "-");
+		}
+	}
+	printf("\n");
+}
+
+int main() {
+	void* mem = malloc(__BENCH_BA_MEM_CAPACITY);
+	uint8_t* const evict = (uint8_t*)calloc(1, __BENCH_BA_EVICT_SIZE);
+	BuddyAllocator_t* ba = mem ? buddy_allocator_create(mem, __BENCH_BA_MEM_CAPACITY) : NULL;
+	if(ba == NULL || evict == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		return EXIT_FAILURE;
+	}
+	const size_t capacity_max = buddy_allocator_capacity_max(ba);
+	const size_t half_max = (capacity_max + sizeof(ChunkHdr_t)) / 2u - sizeof(ChunkHdr_t);
+
+	if(__bench_events_open() == 0) {
+		fprintf(stderr, "No hardware counters (%s), the ticks only are reported\n", strerror(errno));
+	}
+
+	BenchProbe_t minimal = {0};
+	BenchProbe_t cold = {0};
+	BenchProbe_t cold_chain = {0};
+	BenchProbe_t whole = {0};
+	BenchProbe_t half = {0};
+	BenchProbe_t fragmented = {0};
+	for(size_t repeat = 0; repeat < __BENCH_BA_REPEATS_NB; ++repeat) {
+		__bench_keep_best(&minimal, __bench_pair(ba, 1));
+		__bench_keep_best(&cold, __bench_cold_free(ba, evict, 0));
+		__bench_keep_best(&cold_chain, __bench_cold_free(ba, evict, half_max));
+		__bench_keep_best(&whole, __bench_pair(ba, capacity_max));
+		__bench_keep_best(&half, __bench_pair(ba, half_max));
+		__bench_keep_best(&fragmented, __bench_random_pairs(ba));
+	}
+
+	printf("per alloc + free, or per free, over 2^%u bytes\n", __BENCH_BA_MEM_RANK);
+	printf("%-28s %10s", "", "ticks");
+	for(size_t idx = 0; idx < __BENCH_BA_EVENTS_NB; ++idx) {
+		printf(" %10s", events[idx].name);
+	}
+	printf("\n");
+	__bench_print("minimal, empty arena", &minimal);
+	__bench_print("minimal, cold free only", &cold);
+	__bench_print("minimal, cold merge chain", &cold_chain);
+	__bench_print("whole capacity", &whole);
+	__bench_print("half capacity", &half);
+	__bench_print("random, fragmented", &fragmented);
+
+	__bench_events_close();
+	buddy_allocator_destroy(ba);
+	free(evict);
+	free(mem);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,69 @@
+#include "../src/BuddyAllocator.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <unordered_map>
+#include <vector>
+
+// =========================================================
+// = std::pmr containers throughput.
+//
+// Every container is filled and destroyed __BENCH_BAH_ROUNDS times over:
+// - the default resource (operator new),
+// - the buddy resource,
+// - a pool resource upstreamed to the buddy resource.
+//
+// Every node of an unordered_map costs a whole RANK_MIN chunk when it is
+// allocated from the buddy resource directly, so the map is kept small.
+// =========================================================
+
+#define __BENCH_BAH_MEM_RANK (Rank_t)(26)
+#define __BENCH_BAH_VECTOR_ITEMS_NB (size_t)(1u << 20)
+#define __BENCH_BAH_MAP_ITEMS_NB (size_t)(1u << 13)
+#define __BENCH_BAH_ROUNDS (size_t)(20)
+
+typedef void (*BenchFill_t)(std::pmr::memory_resource* resource);
+
+void __bench_vector(std::pmr::memory_resource* resource) {
+	std::pmr::vector<size_t> vector(resource);
+	for(size_t i = 0; i < __BENCH_BAH_VECTOR_ITEMS_NB; ++i) {
+		vector.push_back(i);
+	}
+}
+
+void __bench_map(std::pmr::memory_resource* resource) {
+	std::pmr::unordered_map<size_t, size_t> map(resource);
+	for(size_t i = 0; i < __BENCH_BAH_MAP_ITEMS_NB; ++i) {
+		map.emplace(i, i);
+	}
+}
+
+/**
+ * @return millions of items inserted per second.
+ */
+double __bench_run(BenchFill_t fill, std::pmr::memory_resource* resource, const size_t items_nb) {
+	fill(resource); // Warm up.
+	const auto begin = std::chrono::steady_clock::now();
+	for(size_t round = 0; round < __BENCH_BAH_ROUNDS; ++round) {
+		fill(resource);
+	}
+	const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+	return (double)(items_nb * __BENCH_BAH_ROUNDS) / elapsed.count() / 1e6;
+}
+
+void __bench_report(const char* const name, BenchFill_t fill, const size_t items_nb, buddy::Arena& arena) {
+	std::pmr::unsynchronized_pool_resource pool(arena.resource());
+	printf("%-24s", name);
+	printf(" default %8.2f Mops/s", __bench_run(fill, std::pmr::new_delete_resource(), items_nb));
+	printf(" | buddy %8.2f Mops/s", __bench_run(fill, arena.resource(), items_nb));
+	printf(" | pool over buddy %8.2f Mops/s\n", __bench_run(fill, &pool, items_nb));
+}
+
+int main() {
+	buddy::Arena arena(1ull << __BENCH_BAH_MEM_RANK);
+
+	__bench_report("pmr::vector push_back", __bench_vector, __BENCH_BAH_VECTOR_ITEMS_NB, arena);
+	__bench_report("pmr::unordered_map", __bench_map, __BENCH_BAH_MAP_ITEMS_NB, arena);
+
+	return 0;
+}
@@ -0,0 +1,223 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// =========================================================
+// = DList vs CDList per operation cost.
+//
+// The operations the allocator free lists are made of:
+// - push_front + pop_front of the same node (a split followed by an allocation),
+// - push_front of a batch + remove in a scattered order (buddy merges),
+// - pop_front of an empty list (the split walks up the empty buckets),
+// - push_front or remove of random nodes over a few short lists, so the
+//   head / tail / middle branches of DList are not predictable, as the
+//   buckets of a fragmented allocator.
+//
+// The counter is the TSC on x86 and nanoseconds elsewhere.
+// =========================================================
+
+struct BenchNode;
+struct BenchNode {
+	struct BenchNode* prev;
+	struct BenchNode* next;
+	uint64_t user_data;
+};
+
+typedef struct BenchNode DListNode_t;
+typedef struct BenchNode CDListNode_t;
+
+#include "../src/DList.h"
+#include "../src/CDList.h"
+
+#define __BENCH_DL_NODES_NB (size_t)(4096)
+#define __BENCH_DL_ROUNDS (size_t)(2000)
+
+static inline uint64_t __bench_now() {
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+/**
+ * A stride walk, so the removals do not follow the list order.
+ */
+static inline size_t __bench_scattered(const size_t i) {
+	return (i * 1031u) % __BENCH_DL_NODES_NB;
+}
+
+#define __BENCH_DL_LISTS_NB (size_t)(__BENCH_DL_NODES_NB / 256u)
+#define __BENCH_DL_SHORT_NODES_NB (size_t)(4u * __BENCH_DL_LISTS_NB)
+#define __BENCH_DL_SEQUENCE_SIZE (size_t)(1u << 16)
+
+// Global, so the lists stay in memory as the allocator buckets do and the results are kept.
+CDListNode_t nodes[__BENCH_DL_NODES_NB];
+static DList_t dlists[__BENCH_DL_LISTS_NB];
+static CDList_t cdlists[__BENCH_DL_LISTS_NB];
+static uint8_t sequence[__BENCH_DL_SEQUENCE_SIZE];
+
+static void __bench_sequence_init() {
+	uint32_t state = 2463534242u;
+	for(size_t i = 0; i < __BENCH_DL_SEQUENCE_SIZE; ++i) {
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		sequence[i] = (uint8_t)(state % __BENCH_DL_SHORT_NODES_NB);
+	}
+}
+
+static double __bench_dlist_lifo() {
+	DList_t* const list = dlists;
+	dlist_init(list);
+	dlist_push_front(list, nodes + 0);
+	const uint64_t begin = __bench_now();
+	for(size_t round = 0; round < __BENCH_DL_ROUNDS; ++round) {
+		for(size_t i = 1; i < __BENCH_DL_NODES_NB; ++i) {
+			dlist_push_front(list, nodes + i);
+			nodes[i].user_data += (uint64_t)(uintptr_t)dlist_pop_front(list);
+		}
+	}
+	return (double)(__bench_now() - begin) / (double)(__BENCH_DL_ROUNDS * (__BENCH_DL_NODES_NB - 1u) * 2u);
+}
+
+static double __bench_cdlist_lifo() {
+	CDList_t* const list = cdlists;
+	cdlist_init(list);
+	cdlist_push_front(list, nodes + 0);
+	const uint64_t begin = __bench_now();
+	for(size_t round = 0; round < __BENCH_DL_ROUNDS; ++round) {
+		for(size_t i = 1; i < __BENCH_DL_NODES_NB; ++i) {
+			cdlist_push_front(list, nodes + i);
+			nodes[i].user_data += (uint64_t)(uintptr_t)cdlist_pop_front(list);
+		}
+	}
+	return (double)(__bench_now() - begin) / (double)(__BENCH_DL_ROUNDS * (__BENCH_DL_NODES_NB - 1u) * 2u);
+}
+
+static double __bench_dlist_remove() {
+	DList_t* const list = dlists;
+	dlist_init(list);
+	const uint64_t begin = __bench_now();
+	for(size_t round = 0; round < __BENCH_DL_ROUNDS; ++round) {
+		for(size_t i = 0; i < __BENCH_DL_NODES_NB; ++i) {
+			dlist_push_front(list, nodes + i);
+		}
+		for(size_t i = 0; i < __BENCH_DL_NODES_NB; ++i) {
+			dlist_remove(list, nodes + __bench_scattered(i));
+		}
+	}
+	return (double)(__bench_now() - begin) / (double)(__BENCH_DL_ROUNDS * __BENCH_DL_NODES_NB * 2u);
+}
+
+static double __bench_cdlist_remove() {
+	CDList_t* const list = cdlists;
+	cdlist_init(list);
+	const uint64_t begin = __bench_now();
+	for(size_t round = 0; round < __BENCH_DL_ROUNDS; ++round) {
+		for(size_t i = 0; i < __BENCH_DL_NODES_NB; ++i) {
+			cdlist_push_front(list, nodes + i);
+		}
+		for(size_t i = 0; i < __BENCH_DL_NODES_NB; ++i) {
+			cdlist_remove(nodes + __bench_scattered(i));
+		}
+	}
+	return (double)(__bench_now() - begin) / (double)(__BENCH_DL_ROUNDS * __BENCH_DL_NODES_NB * 2u);
+}
+
+static double __bench_dlist_pop_empty() {
+	DList_t* const lists = dlists;
+	size_t found = 0;
+	for(size_t idx = 0; idx < __BENCH_DL_LISTS_NB; ++idx) {
+		dlist_init(lists + idx);
+	}
+	const uint64_t begin = __bench_now();
+	for(size_t round = 0; round < __BENCH_DL_ROUNDS * 256u; ++round) {
+		for(size_t idx = 0; idx < __BENCH_DL_LISTS_NB; ++idx) {
+			found += dlist_pop_front(lists + idx) ? 1u : 0;
+		}
+	}
+	const uint64_t end = __bench_now();
+	nodes[0].user_data += found;
+	return (double)(end - begin) / (double)(__BENCH_DL_ROUNDS * __BENCH_DL_NODES_NB);
+}
+
+static double __bench_cdlist_pop_empty() {
+	CDList_t* const lists = cdlists;
+	size_t found = 0;
+	for(size_t idx = 0; idx < __BENCH_DL_LISTS_NB; ++idx) {
+		cdlist_init(lists + idx);
+	}
+	const uint64_t begin = __bench_now();
+	for(size_t round = 0; round < __BENCH_DL_ROUNDS * 256u; ++round) {
+		for(size_t idx = 0; idx < __BENCH_DL_LISTS_NB; ++idx) {
+			found += cdlist_pop_front(lists + idx) ? 1u : 0;
+		}
+	}
+	const uint64_t end = __bench_now();
+	nodes[0].user_data += found;
+	return (double)(end - begin) / (double)(__BENCH_DL_ROUNDS * __BENCH_DL_NODES_NB);
+}
+
+static double __bench_dlist_random() {
+	for(size_t idx = 0; idx < __BENCH_DL_LISTS_NB; ++idx) {
+		dlist_init(dlists + idx);
+	}
+	for(size_t i = 0; i < __BENCH_DL_SHORT_NODES_NB; ++i) {
+		nodes[i].user_data = 0;
+	}
+	const uint64_t begin = __bench_now();
+	for(size_t round = 0; round < __BENCH_DL_ROUNDS / 16u; ++round) {
+		for(size_t i = 0; i < __BENCH_DL_SEQUENCE_SIZE; ++i) {
+			DListNode_t* const node = nodes + sequence[i];
+			DList_t* const list = dlists + sequence[i] % __BENCH_DL_LISTS_NB;
+			if(node->user_data) {
+				dlist_remove(list, node);
+			} else {
+				dlist_push_front(list, node);
+			}
+			node->user_data ^= 1u;
+		}
+	}
+	return (double)(__bench_now() - begin) / (double)(__BENCH_DL_ROUNDS / 16u * __BENCH_DL_SEQUENCE_SIZE);
+}
+
+static double __bench_cdlist_random() {
+	for(size_t idx = 0; idx < __BENCH_DL_LISTS_NB; ++idx) {
+		cdlist_init(cdlists + idx);
+	}
+	for(size_t i = 0; i < __BENCH_DL_SHORT_NODES_NB; ++i) {
+		nodes[i].user_data = 0;
+	}
+	const uint64_t begin = __bench_now();
+	for(size_t round = 0; round < __BENCH_DL_ROUNDS / 16u; ++round) {
+		for(size_t i = 0; i < __BENCH_DL_SEQUENCE_SIZE; ++i) {
+			CDListNode_t* const node = nodes + sequence[i];
+			CDList_t* const list = cdlists + sequence[i] % __BENCH_DL_LISTS_NB;
+			if(node->user_data) {
+				cdlist_remove(node);
+			} else {
+				cdlist_push_front(list, node);
+			}
+			node->user_data ^= 1u;
+		}
+	}
+	return (double)(__bench_now() - begin) / (double)(__BENCH_DL_ROUNDS / 16u * __BENCH_DL_SEQUENCE_SIZE);
+}
+
+int main() {
+	__bench_sequence_init();
+	printf("%-28s %10s %10s\n", "ticks per op", "DList", "CDList");
+	printf("%-28s %10.2f %10.2f\n", "push_front + pop_front", __bench_dlist_lifo(), __bench_cdlist_lifo());
+	printf("%-28s %10.2f %10.2f\n", "push_front + remove", __bench_dlist_remove(), __bench_cdlist_remove());
+	printf("%-28s %10.2f %10.2f\n", "pop_front of an empty list", __bench_dlist_pop_empty(), __bench_cdlist_pop_empty());
+	printf("%-28s %10.2f %10.2f\n", "random short lists", __bench_dlist_random(), __bench_cdlist_random());
+	return EXIT_SUCCESS;
+}
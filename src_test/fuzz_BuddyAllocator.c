@@ -0,0 +1,389 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/BuddyAllocator.h"
+
+// =========================================================
+// = Differential fuzzing of the buddy allocator.
+//
+// A byte stream is decoded into interleaved alloc / free / realloc calls.
+// The live allocations are kept in a reference model, and after every call
+// the allocator state is checked against it:
+// - the chunks tile the whole arena, every chunk is aligned to its size,
+// - the busy chunks are exactly the live allocations, of the expected rank,
+// - every free chunk is linked in the bucket of its rank and nowhere else,
+//   the free counters and the free bytes match the buckets,
+// - no two free buddies of the same rank are left unmerged,
+// - an allocation fails if and only if there is no free chunk of its rank or higher,
+// - the live allocations keep their content.
+//
+// Standalone:
+//   fuzz_buddy_allocator [seeds_nb [ops_nb [rank_range]]]
+// runs every seed with the checks on, then the same streams with the
+// checks off and reports the throughput.
+//
+// libFuzzer: build with BUDDY_ALLOCATOR_LIBFUZZER defined and -fsanitize=fuzzer.
+// =========================================================
+
+#define __FUZZ_BA_RANK_RANGE_DEFAULT (Rank_t)(8)
+#define __FUZZ_BA_RANK_RANGE_MAX (Rank_t)(16)
+#define __FUZZ_BA_SEEDS_DEFAULT (size_t)(8)
+#define __FUZZ_BA_OPS_DEFAULT (size_t)(20000)
+#define __FUZZ_BA_OP_SIZE (size_t)(4)
+#define __FUZZ_BA_PATTERN_SIZE (size_t)(64)
+#define __FUZZ_BA_LIVE_MAX (size_t)(1ull << __FUZZ_BA_RANK_RANGE_MAX)
+
+typedef enum {
+	FUZZ_OP_ALLOC = 0,
+	FUZZ_OP_FREE,
+	FUZZ_OP_REALLOC,
+	FUZZ_OP_ALLOC_SMALL,
+	FUZZ_OP_NB
+} FuzzOp_t;
+
+typedef struct {
+	uint8_t* ptr;
+	size_t size;
+	uint8_t pattern;
+} FuzzLive_t;
+
+typedef struct {
+	BuddyAllocator_t* ba;
+	void* mem;
+	Rank_t rank;
+	bool checks;
+	uint64_t seed;
+	size_t op_idx;
+	FuzzLive_t live[__FUZZ_BA_LIVE_MAX];
+	size_t live_nb;
+	uint8_t* chunk_marks; // Per minimal chunk: 1 if a chunk starts there, 2 if it is a free listed one.
+} FuzzCtx_t;
+
+#define __FUZZ_CHECK(ctx, cond) do { \
+	if(!(cond)) { \
+		fprintf(stderr, "FAILED %s at %s:%d, seed %llu, op %zu\n", #cond, __FILE__, __LINE__, \
+		        (unsigned long long)(ctx)->seed, (ctx)->op_idx); \
+		abort(); \
+	} \
+} while(0)
+
+
+// ====================================
+// = Reference model.
+// ====================================
+
+static inline Rank_t __fuzz_expected_rank(const size_t size) {
+	const Rank_t rank = __buddy_allocator_rank(size + sizeof(ChunkHdr_t));
+	return rank < __BUDDY_ALLOCATOR_RANK_MIN ? __BUDDY_ALLOCATOR_RANK_MIN : rank;
+}
+
+static inline size_t __fuzz_offset(const FuzzCtx_t* const ctx, const void* const ptr) {
+	return (size_t)((const uint8_t*)ptr - (const uint8_t*)ctx->mem);
+}
+
+static inline ChunkHdr_t* __fuzz_chunk(const FuzzCtx_t* const ctx, const size_t offset) {
+	return (ChunkHdr_t*)((uint8_t*)ctx->mem + offset);
+}
+
+static void __fuzz_fill(FuzzLive_t* const live) {
+	const size_t prefix = live->size < __FUZZ_BA_PATTERN_SIZE ? live->size : __FUZZ_BA_PATTERN_SIZE;
+	memset(live->ptr, live->pattern, prefix);
+	if(live->size) {
+		live->ptr[live->size - 1u] = live->pattern;
+	}
+}
+
+static void __fuzz_verify(FuzzCtx_t* const ctx, const FuzzLive_t* const live) {
+	const size_t prefix = live->size < __FUZZ_BA_PATTERN_SIZE ? live->size : __FUZZ_BA_PATTERN_SIZE;
+	for(size_t i = 0; i < prefix; ++i) {
+		__FUZZ_CHECK(ctx, live->ptr[i] == live->pattern);
+	}
+	if(live->size) {
+		__FUZZ_CHECK(ctx, live->ptr[live->size - 1u] == live->pattern);
+	}
+}
+
+/**
+ * @return the highest rank of a free chunk or zero.
+ */
+static Rank_t __fuzz_largest_free_rank(const FuzzCtx_t* const ctx) {
+	Rank_t result = 0;
+	for(Rank_t rank = __BUDDY_ALLOCATOR_RANK_MIN; rank <= ctx->rank; ++rank) {
+		if(!cdlist_empty(ctx->ba->buckets + (rank - __BUDDY_ALLOCATOR_RANK_MIN))) {
+			result = rank;
+		}
+	}
+	return result;
+}
+
+
+// ====================================
+// = Invariants.
+// ====================================
+
+static void __fuzz_check(FuzzCtx_t* const ctx) {
+	BuddyAllocator_t* const ba = ctx->ba;
+	const size_t arena_size = 1ull << ctx->rank;
+	const size_t marks_nb = arena_size >> __BUDDY_ALLOCATOR_RANK_MIN;
+	size_t free_nb[__BUDDY_ALLOCATOR_RANK_RANGE + 1u];
+	size_t busy_nb = 0;
+	memset(ctx->chunk_marks, 0, marks_nb);
+	memset(free_nb, 0, sizeof(free_nb));
+
+	// The chunks tile the arena.
+	size_t offset = 0;
+	while(offset < arena_size) {
+		const ChunkHdr_t* const chunk = __fuzz_chunk(ctx, offset);
+		__FUZZ_CHECK(ctx, chunk->rank >= __BUDDY_ALLOCATOR_RANK_MIN && chunk->rank <= ctx->rank);
+		__FUZZ_CHECK(ctx, (offset & ((1ull << chunk->rank) - 1u)) == 0);
+		ctx->chunk_marks[offset >> __BUDDY_ALLOCATOR_RANK_MIN] = 1;
+		if(chunk->busy) {
+			busy_nb++;
+		} else {
+			free_nb[chunk->rank - __BUDDY_ALLOCATOR_RANK_MIN]++;
+
+			// The buddy region always starts with a chunk of the same rank or lower.
+			if(chunk->rank < ctx->rank) {
+				const ChunkHdr_t* const buddy = __fuzz_chunk(ctx, offset ^ (1ull << chunk->rank));
+				__FUZZ_CHECK(ctx, buddy->busy || buddy->rank != chunk->rank);
+			}
+		}
+		offset += 1ull << chunk->rank;
+	}
+	__FUZZ_CHECK(ctx, offset == arena_size);
+
+	// The busy chunks are the live allocations.
+	__FUZZ_CHECK(ctx, busy_nb == ctx->live_nb);
+	for(size_t idx = 0; idx < ctx->live_nb; ++idx) {
+		const FuzzLive_t* const live = ctx->live + idx;
+		const ChunkHdr_t* const chunk = __buddy_allocator_header_ptr(live->ptr);
+		const size_t chunk_offset = __fuzz_offset(ctx, chunk);
+		__FUZZ_CHECK(ctx, chunk_offset < arena_size);
+		__FUZZ_CHECK(ctx, ctx->chunk_marks[chunk_offset >> __BUDDY_ALLOCATOR_RANK_MIN] == 1);
+		__FUZZ_CHECK(ctx, chunk->busy);
+		__FUZZ_CHECK(ctx, chunk->rank == __fuzz_expected_rank(live->size));
+		__fuzz_verify(ctx, live);
+	}
+
+	// The free chunks are linked in their buckets once.
+	size_t free_bytes = 0;
+	for(Rank_t bucket = 0; bucket <= ctx->rank - __BUDDY_ALLOCATOR_RANK_MIN; ++bucket) {
+		CDList_t* const list = ba->buckets + bucket;
+		size_t listed_nb = 0;
+		for(ChunkHdr_t* node = cdlist_end(list)->next; node != cdlist_end(list); node = node->next) {
+			const size_t node_offset = __fuzz_offset(ctx, node);
+			__FUZZ_CHECK(ctx, node_offset < arena_size);
+			__FUZZ_CHECK(ctx, ctx->chunk_marks[node_offset >> __BUDDY_ALLOCATOR_RANK_MIN] == 1);
+			__FUZZ_CHECK(ctx, !(node->busy));
+			__FUZZ_CHECK(ctx, node->rank == bucket + __BUDDY_ALLOCATOR_RANK_MIN);
+			__FUZZ_CHECK(ctx, node->next->prev == node);
+			ctx->chunk_marks[node_offset >> __BUDDY_ALLOCATOR_RANK_MIN] = 2;
+			listed_nb++;
+		}
+		__FUZZ_CHECK(ctx, listed_nb == free_nb[bucket]);
+		__FUZZ_CHECK(ctx, listed_nb == ba->free_nb[bucket]);
+		free_bytes += listed_nb << (bucket + __BUDDY_ALLOCATOR_RANK_MIN);
+	}
+	__FUZZ_CHECK(ctx, free_bytes == ba->free_bytes);
+}
+
+
+// ====================================
+// = Operations.
+// ====================================
+
+/**
+ * Decodes a size spread over all the ranks, a little beyond the arena too.
+ */
+static size_t __fuzz_size(const FuzzCtx_t* const ctx, const uint8_t* const op, const bool small) {
+	const unsigned ranks_nb = small ? 3u : (unsigned)(ctx->rank - __BUDDY_ALLOCATOR_RANK_MIN) + 6u;
+	const unsigned base_rank = __BUDDY_ALLOCATOR_RANK_MIN - 4u + op[1] % ranks_nb;
+	const size_t base = 1ull << base_rank;
+	return base + ((base * (size_t)(op[2] | (op[3] << 8u))) >> 16u);
+}
+
+static void __fuzz_alloc(FuzzCtx_t* const ctx, const size_t size) {
+	const bool expected = __fuzz_largest_free_rank(ctx) >= __fuzz_expected_rank(size);
+	uint8_t* const ptr = buddy_allocator_alloc(ctx->ba, size);
+	if(ctx->checks) {
+		__FUZZ_CHECK(ctx, (ptr != NULL) == expected);
+	}
+	if(ptr) {
+		FuzzLive_t* const live = ctx->live + ctx->live_nb++;
+		live->ptr = ptr;
+		live->size = size;
+		live->pattern = (uint8_t)(ctx->op_idx * 31u + 7u);
+		__fuzz_fill(live);
+	}
+}
+
+static void __fuzz_free(FuzzCtx_t* const ctx, const size_t idx) {
+	FuzzLive_t* const live = ctx->live + idx;
+	if(ctx->checks) {
+		__fuzz_verify(ctx, live);
+	}
+	buddy_allocator_free(ctx->ba, live->ptr);
+	*live = ctx->live[--(ctx->live_nb)];
+}
+
+static void __fuzz_realloc(FuzzCtx_t* const ctx, const size_t idx, const size_t size) {
+	FuzzLive_t* const live = ctx->live + idx;
+	const Rank_t rank = __fuzz_expected_rank(size);
+	const Rank_t old_rank = __buddy_allocator_header_ptr(live->ptr)->rank;
+	const bool expected = rank <= old_rank || __fuzz_largest_free_rank(ctx) >= rank;
+
+	uint8_t* const ptr = buddy_allocator_realloc(ctx->ba, live->ptr, size);
+	if(ctx->checks) {
+		__FUZZ_CHECK(ctx, (ptr != NULL) == expected);
+		__FUZZ_CHECK(ctx, rank > old_rank || ptr == live->ptr);
+	}
+	if(ptr) {
+		// The common pattern prefix is kept.
+		FuzzLive_t resized = *live;
+		resized.ptr = ptr;
+		resized.size = size < live->size ? size : live->size;
+		if(resized.size > __FUZZ_BA_PATTERN_SIZE) {
+			resized.size = __FUZZ_BA_PATTERN_SIZE;
+		}
+		if(ctx->checks) {
+			__fuzz_verify(ctx, &resized);
+		}
+		live->ptr = ptr;
+		live->size = size;
+		__fuzz_fill(live);
+	} else if(ctx->checks) {
+		__fuzz_verify(ctx, live);
+	}
+}
+
+static void __fuzz_op(FuzzCtx_t* const ctx, const uint8_t* const op) {
+	const FuzzOp_t kind = (FuzzOp_t)(op[0] % FUZZ_OP_NB);
+	const size_t idx = ctx->live_nb ? (size_t)(op[1] | (op[2] << 8u)) % ctx->live_nb : 0;
+	if(kind == FUZZ_OP_FREE && ctx->live_nb) {
+		__fuzz_free(ctx, idx);
+	} else if(kind == FUZZ_OP_REALLOC && ctx->live_nb) {
+		__fuzz_realloc(ctx, idx, __fuzz_size(ctx, op, (op[3] & 1u) != 0));
+	} else if(ctx->live_nb < __FUZZ_BA_LIVE_MAX) {
+		__fuzz_alloc(ctx, __fuzz_size(ctx, op, kind != FUZZ_OP_ALLOC));
+	}
+}
+
+/**
+ * Runs the whole stream and frees everything left.
+ */
+static void __fuzz_run(FuzzCtx_t* const ctx, const uint8_t* const data, const size_t size) {
+	ctx->live_nb = 0;
+	for(ctx->op_idx = 0; (ctx->op_idx + 1u) * __FUZZ_BA_OP_SIZE <= size; ctx->op_idx++) {
+		__fuzz_op(ctx, data + ctx->op_idx * __FUZZ_BA_OP_SIZE);
+		if(ctx->checks) {
+			__fuzz_check(ctx);
+		}
+	}
+	while(ctx->live_nb) {
+		__fuzz_free(ctx, ctx->live_nb - 1u);
+	}
+	if(ctx->checks) {
+		__fuzz_check(ctx);
+		__FUZZ_CHECK(ctx, ctx->ba->free_nb[ctx->rank - __BUDDY_ALLOCATOR_RANK_MIN] == 1);
+	}
+}
+
+static bool __fuzz_init(FuzzCtx_t* const ctx, const Rank_t rank_range) {
+	memset(ctx, 0, sizeof(*ctx));
+	ctx->rank = __BUDDY_ALLOCATOR_RANK_MIN + rank_range;
+	ctx->mem = malloc(1ull << ctx->rank);
+	ctx->chunk_marks = malloc(1ull << rank_range);
+	if(ctx->mem && ctx->chunk_marks) {
+		ctx->ba = buddy_allocator_create(ctx->mem, 1ull << ctx->rank);
+	}
+	return ctx->ba != NULL;
+}
+
+
+#ifdef BUDDY_ALLOCATOR_LIBFUZZER
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+	static FuzzCtx_t* ctx = NULL;
+	if(ctx == NULL) {
+		ctx = malloc(sizeof(*ctx));
+		if(ctx == NULL || !__fuzz_init(ctx, __FUZZ_BA_RANK_RANGE_DEFAULT)) {
+			abort();
+		}
+	}
+	ctx->checks = true;
+	__fuzz_run(ctx, data, size);
+	return 0;
+}
+
+#else
+
+static void __fuzz_destroy(FuzzCtx_t* const ctx) {
+	if(ctx->ba) {
+		buddy_allocator_destroy(ctx->ba);
+	}
+	free(ctx->chunk_marks);
+	free(ctx->mem);
+}
+
+static void __fuzz_stream(uint8_t* const data, const size_t size, uint64_t seed) {
+	for(size_t i = 0; i < size; ++i) {
+		// xorshift64*
+		seed ^= seed >> 12;
+		seed ^= seed << 25;
+		seed ^= seed >> 27;
+		data[i] = (uint8_t)((seed * 2685821657736338717ull) >> 56);
+	}
+}
+
+static double __fuzz_seconds() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char** argv) {
+	const size_t seeds_nb = argc > 1 ? strtoull(argv[1], NULL, 10) : __FUZZ_BA_SEEDS_DEFAULT;
+	const size_t ops_nb = argc > 2 ? strtoull(argv[2], NULL, 10) : __FUZZ_BA_OPS_DEFAULT;
+	const unsigned rank_range = argc > 3 ? (unsigned)strtoul(argv[3], NULL, 10) : __FUZZ_BA_RANK_RANGE_DEFAULT;
+	if(rank_range < 1u || rank_range > __FUZZ_BA_RANK_RANGE_MAX) {
+		fprintf(stderr, "The rank range MUST BE 1..%u\n", (unsigned)__FUZZ_BA_RANK_RANGE_MAX);
+		return EXIT_FAILURE;
+	}
+
+	FuzzCtx_t* const ctx = malloc(sizeof(*ctx));
+	uint8_t* const data = malloc(ops_nb * __FUZZ_BA_OP_SIZE);
+	if(ctx == NULL || data == NULL || !__fuzz_init(ctx, (Rank_t)rank_range)) {
+		fprintf(stderr, "Out of memory\n");
+		return EXIT_FAILURE;
+	}
+
+	double checked_seconds = 0;
+	double raw_seconds = 0;
+	for(size_t seed = 1; seed <= seeds_nb; ++seed) {
+		__fuzz_stream(data, ops_nb * __FUZZ_BA_OP_SIZE, seed);
+		ctx->seed = seed;
+
+		ctx->checks = true;
+		double begin = __fuzz_seconds();
+		__fuzz_run(ctx, data, ops_nb * __FUZZ_BA_OP_SIZE);
+		checked_seconds += __fuzz_seconds() - begin;
+
+		ctx->checks = false;
+		begin = __fuzz_seconds();
+		__fuzz_run(ctx, data, ops_nb * __FUZZ_BA_OP_SIZE);
+		raw_seconds += __fuzz_seconds() - begin;
+	}
+
+	printf("%zu seeds x %zu ops over 2^%u bytes: OK\n", seeds_nb, ops_nb, __BUDDY_ALLOCATOR_RANK_MIN + rank_range);
+	printf("checked : %12.0f ops/s\n", (double)(seeds_nb * ops_nb) / checked_seconds);
+	printf("raw     : %12.0f ops/s\n", (double)(seeds_nb * ops_nb) / raw_seconds);
+
+	__fuzz_destroy(ctx);
+	free(ctx);
+	free(data);
+	return EXIT_SUCCESS;
+}
+
+#endif // BUDDY_ALLOCATOR_LIBFUZZER
@@ -6,6 +6,7 @@
 #define __TEST_BA_MEM_CAPACITY (size_t)(1ull << __TEST_BA_MEM_RANK)
 #define __TEST_BA_STORAGE_SIZE (size_t)(1ull << __TEST_BA_MEM_RANK_RANGE)
 #define __TEST_BA_INTEGRITY_ITERATIONS (unsigned)999
+#define __TEST_BA_REMOTE_THREADS (unsigned)4
 #define __TEST_BA_VERBOSE 0
 
 void test_integral(BuddyAllocator_t* ba) {
@@ -83,6 +84,227 @@ void test_integrity(BuddyAllocator_t* ba) {
 	}
 }
 
+typedef struct {
+	BuddyAllocator_t* ba;
+	void** storage;
+	size_t first;
+	size_t step;
+	size_t storage_nb;
+} TestRemoteFreeArg_t;
+
+void* __test_remote_free_thread(void* raw_arg) {
+	TestRemoteFreeArg_t* const arg = (TestRemoteFreeArg_t*)raw_arg;
+	for(size_t i = arg->first; i < arg->storage_nb; i += arg->step) {
+		buddy_allocator_free(arg->ba, arg->storage[i]);
+	}
+	return NULL;
+}
+
+void test_remote_free(BuddyAllocator_t* ba) {
+	TRACE_CALL;
+	void* storage[__TEST_BA_STORAGE_SIZE];
+	pthread_t threads[__TEST_BA_REMOTE_THREADS];
+	TestRemoteFreeArg_t args[__TEST_BA_REMOTE_THREADS];
+	const size_t capacity_max = buddy_allocator_capacity_max(ba);
+
+	buddy_allocator_set_owner(ba);
+
+	for(size_t i = 0; i < __TEST_BA_STORAGE_SIZE; i++) {
+		storage[i] = buddy_allocator_alloc(ba, 1);
+		assert(storage[i]);
+	}
+
+	for(unsigned i = 0; i < __TEST_BA_REMOTE_THREADS; i++) {
+		args[i].ba = ba;
+		args[i].storage = storage;
+		args[i].first = i;
+		args[i].step = __TEST_BA_REMOTE_THREADS;
+		args[i].storage_nb = __TEST_BA_STORAGE_SIZE;
+		assert(pthread_create(threads + i, NULL, __test_remote_free_thread, args + i) == 0);
+	}
+	for(unsigned i = 0; i < __TEST_BA_REMOTE_THREADS; i++) {
+		assert(pthread_join(threads[i], NULL) == 0);
+	}
+
+	// The queued chunks are freed once more, from the other threads and from the owner.
+	for(unsigned i = 0; i < __TEST_BA_REMOTE_THREADS; i++) {
+		args[i].first = (i + 1u) % __TEST_BA_REMOTE_THREADS;
+		assert(pthread_create(threads + i, NULL, __test_remote_free_thread, args + i) == 0);
+	}
+	for(unsigned i = 0; i < __TEST_BA_REMOTE_THREADS; i++) {
+		assert(pthread_join(threads[i], NULL) == 0);
+	}
+	buddy_allocator_free(ba, storage[0]);
+
+	size_t queued_nb = 0;
+	for(const ChunkHdr_t* chunk = ba->remote_free_head; chunk; chunk = chunk->next) {
+		assert(chunk->queued);
+		queued_nb++;
+	}
+	assert(queued_nb == __TEST_BA_STORAGE_SIZE);
+
+	// Nothing is coalesced until the owner allocates.
+	assert(ba->remote_free_head != NULL);
+	for(Rank_t bucket = 0; bucket < __BUDDY_ALLOCATOR_RANK_RANGE; ++bucket) {
+		assert(cdlist_empty(ba->buckets + bucket));
+	}
+
+	void* whole = buddy_allocator_alloc(ba, capacity_max);
+	assert(whole);
+	assert(ba->remote_free_head == NULL);
+
+	// The owner frees directly.
+	buddy_allocator_free(ba, whole);
+	assert(ba->remote_free_head == NULL);
+
+	buddy_allocator_reset_owner(ba);
+}
+
+typedef struct {
+	BuddyAllocator_t* ba;
+	void** cache;
+	size_t cache_nb;
+	size_t calls_nb;
+	Rank_t last_rank;
+} TestPressureCtx_t;
+
+void __test_pressure_shrink(void* raw_ctx, Rank_t rank) {
+	TestPressureCtx_t* const ctx = (TestPressureCtx_t*)raw_ctx;
+	ctx->calls_nb++;
+	ctx->last_rank = rank;
+	while(ctx->cache_nb) {
+		buddy_allocator_free(ctx->ba, ctx->cache[--(ctx->cache_nb)]);
+	}
+}
+
+void __test_pressure_count(void* raw_ctx, Rank_t rank) {
+	TestPressureCtx_t* const ctx = (TestPressureCtx_t*)raw_ctx;
+	ctx->calls_nb++;
+	ctx->last_rank = rank;
+}
+
+void __test_free_nb_consistent(BuddyAllocator_t* ba) {
+	size_t free_bytes = 0;
+	for(Rank_t bucket = 0; bucket <= __BUDDY_ALLOCATOR_RANK_RANGE; ++bucket) {
+		assert(ba->free_nb[bucket] == cdlist_size(ba->buckets + bucket));
+		free_bytes += ba->free_nb[bucket] << (bucket + __BUDDY_ALLOCATOR_RANK_MIN);
+	}
+	assert(free_bytes == ba->free_bytes);
+}
+
+void test_pressure_on_failure(BuddyAllocator_t* ba) {
+	TRACE_CALL;
+	void* cache[__TEST_BA_STORAGE_SIZE];
+	TestPressureCtx_t ctx;
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.ba = ba;
+	ctx.cache = cache;
+
+	// The cache takes the whole arena.
+	for(size_t i = 0; i < __TEST_BA_STORAGE_SIZE; i++) {
+		cache[ctx.cache_nb] = buddy_allocator_alloc(ba, 1);
+		assert(cache[ctx.cache_nb]);
+		ctx.cache_nb++;
+	}
+	__test_free_nb_consistent(ba);
+	assert(buddy_allocator_alloc(ba, 1) == NULL);
+
+	assert(buddy_allocator_pressure_register(ba, __test_pressure_shrink, &ctx) == 0);
+	const size_t capacity_max = buddy_allocator_capacity_max(ba);
+	void* whole = buddy_allocator_alloc(ba, capacity_max);
+	assert(whole);
+	assert(ctx.calls_nb == 1);
+	assert(ctx.last_rank == __TEST_BA_MEM_RANK);
+	assert(ctx.cache_nb == 0);
+
+	// Nothing to release anymore, the retry fails too.
+	assert(buddy_allocator_alloc(ba, 1) == NULL);
+	assert(ctx.calls_nb == 2);
+
+	buddy_allocator_free(ba, whole);
+	buddy_allocator_pressure_unregister(ba, __test_pressure_shrink, &ctx);
+	assert(ba->pressure_handlers_nb == 0);
+	__test_free_nb_consistent(ba);
+}
+
+void test_pressure_watermark(BuddyAllocator_t* ba) {
+	TRACE_CALL;
+	void* storage[__TEST_BA_STORAGE_SIZE];
+	TestPressureCtx_t ctx;
+	memset(&ctx, 0, sizeof(ctx));
+	assert(buddy_allocator_pressure_register(ba, __test_pressure_count, &ctx) == 0);
+
+	// At least 4 chunks of 4 minimal chunks each, i.e. a half of the arena.
+	const Rank_t rank = __BUDDY_ALLOCATOR_RANK_MIN + 2u;
+	buddy_allocator_set_watermark(ba, rank, 4);
+
+	for(size_t i = 0; i < __TEST_BA_STORAGE_SIZE / 2u; i++) {
+		storage[i] = buddy_allocator_alloc(ba, 1);
+		assert(storage[i]);
+	}
+	assert(ctx.calls_nb == 0);
+
+	// Crossed once.
+	storage[__TEST_BA_STORAGE_SIZE / 2u] = buddy_allocator_alloc(ba, 1);
+	assert(ctx.calls_nb == 1);
+	assert(ctx.last_rank == rank);
+	storage[__TEST_BA_STORAGE_SIZE / 2u + 1u] = buddy_allocator_alloc(ba, 1);
+	assert(ctx.calls_nb == 1);
+
+	// Re-armed by an allocation above the watermark.
+	buddy_allocator_free(ba, storage[__TEST_BA_STORAGE_SIZE / 2u + 1u]);
+	buddy_allocator_free(ba, storage[__TEST_BA_STORAGE_SIZE / 2u]);
+	buddy_allocator_free(ba, storage[0]);
+	storage[0] = buddy_allocator_alloc(ba, 1);
+	assert(ctx.calls_nb == 1);
+	storage[__TEST_BA_STORAGE_SIZE / 2u] = buddy_allocator_alloc(ba, 1);
+	assert(ctx.calls_nb == 2);
+
+	for(size_t i = 0; i <= __TEST_BA_STORAGE_SIZE / 2u; i++) {
+		buddy_allocator_free(ba, storage[i]);
+	}
+	buddy_allocator_set_watermark(ba, rank, 0);
+	assert(ba->watermarks_mask == 0);
+	buddy_allocator_pressure_unregister(ba, __test_pressure_count, &ctx);
+	__test_free_nb_consistent(ba);
+}
+
+void test_realloc(BuddyAllocator_t* ba) {
+	TRACE_CALL;
+	const size_t capacity_max = buddy_allocator_capacity_max(ba);
+	const size_t chunk_capacity = (1ull << __BUDDY_ALLOCATOR_RANK_MIN) - sizeof(ChunkHdr_t);
+
+	size_t* first = buddy_allocator_realloc(ba, NULL, 1);
+	assert(first);
+	*first = 42;
+
+	// The same rank.
+	assert(buddy_allocator_realloc(ba, first, chunk_capacity) == first);
+
+	// Grows by moving.
+	size_t* second = buddy_allocator_realloc(ba, first, chunk_capacity + 1u);
+	assert(second && second != first);
+	assert(*second == 42);
+	assert(__buddy_allocator_header_ptr(second)->rank == __BUDDY_ALLOCATOR_RANK_MIN + 1u);
+
+	// Out of memory, the chunk is left untouched.
+	assert(buddy_allocator_realloc(ba, second, capacity_max) == NULL);
+	assert(*second == 42);
+
+	// Shrinks in place, the released half is free.
+	assert(buddy_allocator_realloc(ba, second, 1) == second);
+	assert(__buddy_allocator_header_ptr(second)->rank == __BUDDY_ALLOCATOR_RANK_MIN);
+	__test_free_nb_consistent(ba);
+
+	buddy_allocator_free(ba, second);
+	void* whole = buddy_allocator_realloc(ba, NULL, capacity_max);
+	assert(whole);
+	assert(buddy_allocator_realloc(ba, whole, 1) == whole);
+	assert(ba->free_nb[0] == 1);
+	buddy_allocator_free(ba, whole);
+	__test_free_nb_consistent(ba);
+}
+
 int main() {
 	TRACE_CALL;
 
@@ -101,6 +323,10 @@ int main() {
 	test_integral(ba);
 	test_capacity(ba);
 	test_integrity(ba);
+	test_remote_free(ba);
+	test_pressure_on_failure(ba);
+	test_pressure_watermark(ba);
+	test_realloc(ba);
 
 	if(__TEST_BA_VERBOSE) {
 		__buddy_allocator_dump(ba);
@@ -0,0 +1,255 @@
+#include "test_environment.h"
+#include "../src/BuddyAllocatorCompact.h"
+
+#define __TEST_BAC_MEM_RANK_RANGE (Rank_t)(5)
+#define __TEST_BAC_MEM_RANK (Rank_t)(__TEST_BAC_MEM_RANK_RANGE + __BUDDY_ALLOCATOR_RANK_MIN)
+#define __TEST_BAC_MEM_CAPACITY (size_t)(1ull << __TEST_BAC_MEM_RANK)
+#define __TEST_BAC_STORAGE_SIZE (size_t)(1ull << __TEST_BAC_MEM_RANK_RANGE)
+#define __TEST_BAC_CHUNK_CAPACITY (size_t)((1ull << __BUDDY_ALLOCATOR_RANK_MIN) - sizeof(ChunkHdr_t))
+#define __TEST_BAC_VERBOSE 0
+
+typedef struct {
+	size_t* handles[__TEST_BAC_STORAGE_SIZE];
+	size_t relocations_nb;
+} TestHandles_t;
+
+void __test_relocate(void* raw_ctx, void* old_ptr, void* new_ptr) {
+	TestHandles_t* const ctx = (TestHandles_t*)raw_ctx;
+	for(size_t i = 0; i < __TEST_BAC_STORAGE_SIZE; ++i) {
+		if(ctx->handles[i] == old_ptr) {
+			ctx->handles[i] = new_ptr;
+			ctx->relocations_nb++;
+			return;
+		}
+	}
+	assert(false);
+}
+
+void __test_fill(size_t* const chunk, const size_t id) {
+	for(size_t j = 0; j < __TEST_BAC_CHUNK_CAPACITY / sizeof(size_t); ++j) {
+		chunk[j] = id ^ j;
+	}
+}
+
+void __test_check(const TestHandles_t* const ctx) {
+	for(size_t i = 0; i < __TEST_BAC_STORAGE_SIZE; ++i) {
+		if(ctx->handles[i]) {
+			for(size_t j = 0; j < __TEST_BAC_CHUNK_CAPACITY / sizeof(size_t); ++j) {
+				assert(ctx->handles[i][j] == (i ^ j));
+			}
+		}
+	}
+}
+
+void __test_release(BuddyAllocator_t* ba, TestHandles_t* const ctx) {
+	for(size_t i = 0; i < __TEST_BAC_STORAGE_SIZE; ++i) {
+		buddy_allocator_free(ba, ctx->handles[i]);
+		ctx->handles[i] = NULL;
+	}
+	assert(ba->free_nb[__TEST_BAC_MEM_RANK_RANGE - 1u] == 0);
+	void* whole = buddy_allocator_alloc(ba, buddy_allocator_capacity_max(ba));
+	assert(whole);
+	buddy_allocator_free(ba, whole);
+}
+
+/**
+ * Fills the arena with minimal chunks. Every fourth one of the first @a pinned_nb is pinned,
+ * the chunks 4k+2 and 4k+3 are freed, so the largest free rank is RANK_MIN + 1.
+ */
+void __test_fragment(BuddyCompactor_t* compactor, TestHandles_t* const ctx, const uint8_t relocator, const size_t pinned_nb) {
+	for(size_t i = 0; i < __TEST_BAC_STORAGE_SIZE; ++i) {
+		if(i < pinned_nb && i % 4u == 0) {
+			ctx->handles[i] = buddy_allocator_alloc(compactor->ba, 1);
+		} else {
+			ctx->handles[i] = buddy_compactor_alloc(compactor, 1, relocator);
+		}
+		assert(ctx->handles[i]);
+		__test_fill(ctx->handles[i], i);
+	}
+	for(size_t i = 0; i < __TEST_BAC_STORAGE_SIZE; ++i) {
+		if(i % 4u >= 2u) {
+			buddy_allocator_free(compactor->ba, ctx->handles[i]);
+			ctx->handles[i] = NULL;
+		}
+	}
+}
+
+void test_compact(BuddyCompactor_t* compactor, const uint8_t relocator, TestHandles_t* const ctx) {
+	TRACE_CALL;
+	BuddyCompactReport_t report;
+	__test_fragment(compactor, ctx, relocator, __TEST_BAC_STORAGE_SIZE / 2u);
+
+	// Nothing to do.
+	assert(buddy_compactor_compact(compactor, __BUDDY_ALLOCATOR_RANK_MIN + 1u, &report));
+	assert(report.chunks_moved == 0);
+
+	// Two movable chunks block every region of the upper half.
+	assert(buddy_compactor_compact(compactor, __BUDDY_ALLOCATOR_RANK_MIN + 2u, &report));
+	assert(report.largest_free_rank_before == __BUDDY_ALLOCATOR_RANK_MIN + 1u);
+	assert(report.largest_free_rank_after == __BUDDY_ALLOCATOR_RANK_MIN + 2u);
+	assert(report.chunks_moved == 2);
+	assert(report.bytes_moved == (2ull << __BUDDY_ALLOCATOR_RANK_MIN));
+	assert(ctx->relocations_nb == 2);
+	__test_check(ctx);
+
+	// The whole upper half, the two chunks moved before landed there too.
+	assert(buddy_compactor_compact(compactor, __TEST_BAC_MEM_RANK - 1u, &report));
+	assert(report.largest_free_rank_after == __TEST_BAC_MEM_RANK - 1u);
+	assert(report.chunks_moved == 8);
+	assert(ctx->relocations_nb == 10);
+	__test_check(ctx);
+
+	// The lower half is pinned.
+	assert(!buddy_compactor_compact(compactor, __TEST_BAC_MEM_RANK, &report));
+	assert(report.chunks_moved == 0);
+	assert(report.largest_free_rank_after == __TEST_BAC_MEM_RANK - 1u);
+
+	if(__TEST_BAC_VERBOSE) {
+		__buddy_allocator_dump(compactor->ba);
+	}
+
+	__test_release(compactor->ba, ctx);
+}
+
+void test_compact_pinned(BuddyCompactor_t* compactor, const uint8_t relocator, TestHandles_t* const ctx) {
+	TRACE_CALL;
+	BuddyCompactReport_t report;
+	__test_fragment(compactor, ctx, relocator, __TEST_BAC_STORAGE_SIZE);
+
+	assert(!buddy_compactor_compact(compactor, __BUDDY_ALLOCATOR_RANK_MIN + 2u, &report));
+	assert(report.chunks_moved == 0);
+	assert(report.largest_free_rank_after == __BUDDY_ALLOCATOR_RANK_MIN + 1u);
+
+	// Unpinned by freeing.
+	buddy_allocator_free(compactor->ba, ctx->handles[0]);
+	ctx->handles[0] = NULL;
+	assert(buddy_compactor_compact(compactor, __BUDDY_ALLOCATOR_RANK_MIN + 2u, &report));
+	assert(report.chunks_moved == 1);
+	__test_check(ctx);
+
+	__test_release(compactor->ba, ctx);
+}
+
+void test_compact_no_room(BuddyCompactor_t* compactor, const uint8_t relocator, TestHandles_t* const ctx) {
+	TRACE_CALL;
+	BuddyCompactReport_t report;
+	for(size_t i = 0; i < __TEST_BAC_STORAGE_SIZE; ++i) {
+		ctx->handles[i] = buddy_compactor_alloc(compactor, 1, relocator);
+		assert(ctx->handles[i]);
+		__test_fill(ctx->handles[i], i);
+	}
+	buddy_allocator_free(compactor->ba, ctx->handles[5]);
+	ctx->handles[5] = NULL;
+
+	// The buddy of the only free chunk has nowhere to go.
+	const size_t relocations_nb = ctx->relocations_nb;
+	assert(!buddy_compactor_compact(compactor, __BUDDY_ALLOCATOR_RANK_MIN + 1u, &report));
+	assert(report.chunks_moved == 0);
+	assert(ctx->relocations_nb == relocations_nb);
+	assert(report.largest_free_rank_after == __BUDDY_ALLOCATOR_RANK_MIN);
+	__test_check(ctx);
+
+	__test_release(compactor->ba, ctx);
+}
+
+typedef struct {
+	BuddyCompactor_t* compactor;
+	TestHandles_t* handles;
+	void* ptr;
+	bool refused;
+} TestRemoteCtx_t;
+
+void* __test_remote_free_thread(void* raw_ctx) {
+	TestRemoteCtx_t* const ctx = (TestRemoteCtx_t*)raw_ctx;
+	buddy_allocator_free(ctx->compactor->ba, ctx->ptr);
+	return NULL;
+}
+
+void* __test_remote_compact_thread(void* raw_ctx) {
+	TestRemoteCtx_t* const ctx = (TestRemoteCtx_t*)raw_ctx;
+	buddy_allocator_free(ctx->compactor->ba, ctx->ptr);
+	ctx->refused = !buddy_compactor_compact(ctx->compactor, __BUDDY_ALLOCATOR_RANK_MIN + 2u, NULL);
+	return NULL;
+}
+
+/**
+ * The moved object is freed by another thread from within the relocator, i.e. while it is moved.
+ */
+void __test_relocate_freed(void* raw_ctx, void* old_ptr, void* new_ptr) {
+	TestRemoteCtx_t* const ctx = (TestRemoteCtx_t*)raw_ctx;
+	pthread_t thread;
+	__test_relocate(ctx->handles, old_ptr, new_ptr);
+	for(size_t i = 0; i < __TEST_BAC_STORAGE_SIZE; ++i) {
+		if(ctx->handles->handles[i] == new_ptr) {
+			ctx->handles->handles[i] = NULL;
+		}
+	}
+	ctx->ptr = old_ptr;
+	assert(pthread_create(&thread, NULL, __test_remote_free_thread, ctx) == 0);
+	assert(pthread_join(thread, NULL) == 0);
+}
+
+void test_compact_remote(BuddyCompactor_t* compactor, TestHandles_t* const ctx) {
+	TRACE_CALL;
+	BuddyCompactReport_t report;
+	TestRemoteCtx_t remote;
+	memset(&remote, 0, sizeof(remote));
+	remote.compactor = compactor;
+	remote.handles = ctx;
+	const uint8_t relocator = buddy_compactor_register(compactor, __test_relocate_freed, &remote);
+	assert(relocator);
+
+	buddy_allocator_set_owner(compactor->ba);
+	__test_fragment(compactor, ctx, relocator, 0);
+
+	// A non-owner frees a movable chunk, it is queued, and the compaction is refused.
+	const size_t relocations_nb = ctx->relocations_nb;
+	pthread_t thread;
+	remote.ptr = ctx->handles[0];
+	ctx->handles[0] = NULL;
+	assert(pthread_create(&thread, NULL, __test_remote_compact_thread, &remote) == 0);
+	assert(pthread_join(thread, NULL) == 0);
+	assert(remote.refused);
+	assert(ctx->relocations_nb == relocations_nb);
+	assert(compactor->ba->remote_free_head != NULL);
+
+	// The owner drains first; the chunk moved is freed while moved, so its copy is freed too.
+	assert(buddy_compactor_compact(compactor, __BUDDY_ALLOCATOR_RANK_MIN + 2u, &report));
+	assert(compactor->ba->remote_free_head == NULL);
+	assert(report.chunks_moved == 1);
+	assert(ctx->relocations_nb == relocations_nb + 1u);
+	__test_check(ctx);
+
+	__test_release(compactor->ba, ctx);
+	buddy_allocator_reset_owner(compactor->ba);
+}
+
+int main() {
+	TRACE_CALL;
+
+	void* mem = malloc(__TEST_BAC_MEM_CAPACITY);
+	assert(mem);
+
+	BuddyAllocator_t* ba = buddy_allocator_create(mem, __TEST_BAC_MEM_CAPACITY);
+	assert(ba);
+
+	BuddyCompactor_t* compactor = buddy_compactor_create(ba);
+	assert(compactor);
+
+	TestHandles_t ctx;
+	memset(&ctx, 0, sizeof(ctx));
+	const uint8_t relocator = buddy_compactor_register(compactor, __test_relocate, &ctx);
+	assert(relocator);
+	assert(buddy_compactor_alloc(compactor, 1, relocator + 1u) == NULL);
+
+	test_compact(compactor, relocator, &ctx);
+	test_compact_pinned(compactor, relocator, &ctx);
+	test_compact_no_room(compactor, relocator, &ctx);
+	test_compact_remote(compactor, &ctx);
+
+	buddy_compactor_destroy(compactor);
+	buddy_allocator_destroy(ba);
+	free(mem);
+
+	return 0;
+}
@@ -0,0 +1,276 @@
+#include "test_environment.h"
+#include "../src/BuddyAllocatorFile.h"
+
+#include <signal.h>
+#include <sys/wait.h>
+
+#define __TEST_BAF_RAW_RANK (Rank_t)(__BUDDY_ALLOCATOR_RANK_MIN + 8)
+#define __TEST_BAF_FILE_SIZE (size_t)((1ull << __TEST_BAF_RAW_RANK) + __BUDDY_FILE_META_SIZE + 4096u)
+#define __TEST_BAF_RECORDS_NB (size_t)(16)
+#define __TEST_BAF_CHUNKS_MAX (size_t)(1ull << (__TEST_BAF_RAW_RANK - __BUDDY_ALLOCATOR_RANK_MIN))
+#define __TEST_BAF_LARGE_FILE_SIZE (size_t)((1ull << (__BUDDY_ALLOCATOR_RANK_MAX + 1u)) + __BUDDY_FILE_META_SIZE)
+
+typedef struct {
+	size_t records_nb;
+	BuddyOffset_t records[__TEST_BAF_RECORDS_NB];
+} TestRoot_t;
+
+static char __test_path[128];
+
+void __test_fill(BuddyFileArena_t* arena) {
+	TestRoot_t* const root = buddy_file_arena_alloc(arena, sizeof(TestRoot_t));
+	assert(root);
+	for(size_t i = 0; i < __TEST_BAF_RECORDS_NB; ++i) {
+		size_t* const record = buddy_file_arena_alloc(arena, (i + 1u) * sizeof(size_t));
+		assert(record);
+		for(size_t j = 0; j <= i; ++j) {
+			record[j] = i * j;
+		}
+		root->records[i] = buddy_shared_allocator_offset(arena->allocator, record);
+	}
+	root->records_nb = __TEST_BAF_RECORDS_NB;
+	buddy_file_arena_set_root(arena, root);
+}
+
+void __test_check_and_release(BuddyFileArena_t* arena) {
+	TestRoot_t* const root = buddy_file_arena_root(arena);
+	assert(root);
+	assert(root->records_nb == __TEST_BAF_RECORDS_NB);
+
+	const size_t capacity_max = buddy_shared_allocator_capacity_max(arena->allocator);
+	assert(buddy_file_arena_alloc(arena, capacity_max) == NULL);
+
+	for(size_t i = 0; i < __TEST_BAF_RECORDS_NB; ++i) {
+		size_t* const record = buddy_shared_allocator_ptr(arena->allocator, root->records[i]);
+		for(size_t j = 0; j <= i; ++j) {
+			assert(record[j] == i * j);
+		}
+		buddy_file_arena_free(arena, record);
+	}
+	buddy_file_arena_set_root(arena, NULL);
+	buddy_file_arena_free(arena, root);
+
+	void* whole = buddy_file_arena_alloc(arena, capacity_max);
+	assert(whole);
+	buddy_file_arena_free(arena, whole);
+}
+
+void test_reopen() {
+	TRACE_CALL;
+	BuddyFileArena_t* arena = buddy_allocator_open_file(__test_path, __TEST_BAF_FILE_SIZE);
+	assert(arena);
+	assert(arena->allocator->raw_memory_rank == __TEST_BAF_RAW_RANK);
+	assert(buddy_file_arena_root(arena) == NULL);
+	__test_fill(arena);
+	assert(buddy_file_arena_close(arena) == 0);
+
+	// The size is taken from the existing file.
+	arena = buddy_allocator_open_file(__test_path, 0);
+	assert(arena);
+	assert(arena->log_nb == 0);
+	__test_check_and_release(arena);
+	assert(buddy_file_arena_close(arena) == 0);
+
+	unlink(__test_path);
+}
+
+void test_exclusive_open() {
+	TRACE_CALL;
+	BuddyFileArena_t* arena = buddy_allocator_open_file(__test_path, __TEST_BAF_FILE_SIZE);
+	assert(arena);
+	assert(buddy_allocator_open_file(__test_path, 0) == NULL);
+	assert(buddy_file_arena_close(arena) == 0);
+
+	// The lock goes away with the arena.
+	arena = buddy_allocator_open_file(__test_path, 0);
+	assert(arena);
+	assert(buddy_file_arena_close(arena) == 0);
+
+	unlink(__test_path);
+}
+
+typedef struct {
+	BuddyOffset_t offset;
+	Rank_t rank;
+	bool busy;
+} TestChunk_t;
+
+/**
+ * Lists the chunks by walking the headers.
+ * @return the number of chunks.
+ */
+size_t __test_scan(BuddyFileArena_t* arena, TestChunk_t* const chunks) {
+	BuddySharedAllocator_t* const ba = arena->allocator;
+	size_t result = 0;
+	size_t offset = 0;
+	while(offset < (1ull << ba->raw_memory_rank)) {
+		const BuddySharedHdr_t* const chunk = __buddy_shared_allocator_hdr(ba, ba->raw_memory_off + offset);
+		assert(result < __TEST_BAF_CHUNKS_MAX);
+		chunks[result].offset = ba->raw_memory_off + offset;
+		chunks[result].rank = chunk->rank;
+		chunks[result].busy = chunk->busy;
+		result++;
+		offset += 1ull << chunk->rank;
+	}
+	return result;
+}
+
+/**
+ * Power loss after a flush and a few splits and merges: the log reached the
+ * disk, of the allocator pages only one in every stride did.
+ */
+void __test_power_loss(const size_t stride) {
+	BuddyFileArena_t* arena = buddy_allocator_open_file(__test_path, __TEST_BAF_FILE_SIZE);
+	assert(arena);
+
+	void* storage[8];
+	for(size_t i = 0; i < 8; ++i) {
+		storage[i] = buddy_file_arena_alloc(arena, (1ull << (__BUDDY_ALLOCATOR_RANK_MIN + i % 3u)) - 64u);
+		assert(storage[i]);
+	}
+	assert(buddy_file_arena_flush(arena) == 0);
+
+	uint8_t* const area = arena->map_ptr + __BUDDY_FILE_META_SIZE;
+	const size_t area_size = arena->map_size - __BUDDY_FILE_META_SIZE;
+	uint8_t* const snapshot = malloc(area_size);
+	assert(snapshot);
+	memcpy(snapshot, area, area_size);
+
+	for(size_t i = 0; i < 8; i += 2) {
+		buddy_file_arena_free(arena, storage[i]);
+	}
+	void* const big = buddy_file_arena_alloc(arena, 1ull << (__TEST_BAF_RAW_RANK - 2u));
+	void* const small = buddy_file_arena_alloc(arena, 1);
+	assert(big && small);
+	buddy_file_arena_free(arena, storage[1]);
+
+	TestChunk_t expected[__TEST_BAF_CHUNKS_MAX];
+	const size_t expected_nb = __test_scan(arena, expected);
+
+	for(size_t page = 0; page * 4096u < area_size; ++page) {
+		if(page % stride) {
+			const size_t size = area_size - page * 4096u < 4096u ? area_size - page * 4096u : 4096u;
+			memcpy(area + page * 4096u, snapshot + page * 4096u, size);
+		}
+	}
+	free(snapshot);
+	__buddy_file_arena_unmap(arena);
+
+	arena = buddy_allocator_open_file(__test_path, 0);
+	assert(arena);
+	assert(arena->log_nb == 0);
+
+	TestChunk_t recovered[__TEST_BAF_CHUNKS_MAX];
+	assert(__test_scan(arena, recovered) == expected_nb);
+	for(size_t i = 0; i < expected_nb; ++i) {
+		assert(recovered[i].offset == expected[i].offset);
+		assert(recovered[i].rank == expected[i].rank);
+		assert(recovered[i].busy == expected[i].busy);
+	}
+
+	for(size_t i = 3; i < 8; i += 2) {
+		buddy_file_arena_free(arena, storage[i]);
+	}
+	buddy_file_arena_free(arena, big);
+	buddy_file_arena_free(arena, small);
+	void* whole = buddy_file_arena_alloc(arena, buddy_shared_allocator_capacity_max(arena->allocator));
+	assert(whole);
+	buddy_file_arena_free(arena, whole);
+	assert(buddy_file_arena_close(arena) == 0);
+
+	unlink(__test_path);
+}
+
+void test_recover_power_loss() {
+	TRACE_CALL;
+	__test_power_loss(1);
+	__test_power_loss(2);
+	__test_power_loss(3);
+}
+
+/**
+ * The log is checkpointed when it is full, the records stay in the current epoch.
+ */
+void test_log_wrap() {
+	TRACE_CALL;
+	BuddyFileArena_t* arena = buddy_allocator_open_file(__test_path, __TEST_BAF_FILE_SIZE);
+	assert(arena);
+	const uint64_t epoch = arena->header->epoch;
+	for(size_t i = 0; i < __BUDDY_FILE_LOG_CAPACITY; ++i) {
+		buddy_file_arena_free(arena, buddy_file_arena_alloc(arena, 1));
+	}
+	assert(arena->header->epoch == epoch + 1u);
+	assert(arena->log_nb == __BUDDY_FILE_LOG_CAPACITY);
+	__buddy_file_arena_unmap(arena);
+
+	arena = buddy_allocator_open_file(__test_path, 0);
+	assert(arena);
+	void* whole = buddy_file_arena_alloc(arena, buddy_shared_allocator_capacity_max(arena->allocator));
+	assert(whole);
+	buddy_file_arena_free(arena, whole);
+	assert(buddy_file_arena_close(arena) == 0);
+
+	unlink(__test_path);
+}
+
+/**
+ * A file larger than 2^RANK_MAX bytes is opened, the arena is capped.
+ */
+void test_large_file() {
+	TRACE_CALL;
+	BuddyFileArena_t* arena = buddy_allocator_open_file(__test_path, __TEST_BAF_LARGE_FILE_SIZE);
+	assert(arena);
+	assert(arena->allocator->raw_memory_rank == __BUDDY_ALLOCATOR_RANK_MAX);
+	void* small = buddy_file_arena_alloc(arena, 1);
+	assert(small);
+	buddy_file_arena_free(arena, small);
+	assert(buddy_file_arena_close(arena) == 0);
+
+	arena = buddy_allocator_open_file(__test_path, 0);
+	assert(arena);
+	assert(arena->allocator->raw_memory_rank == __BUDDY_ALLOCATOR_RANK_MAX);
+	assert(buddy_file_arena_close(arena) == 0);
+
+	unlink(__test_path);
+}
+
+void test_recover_killed() {
+	TRACE_CALL;
+	const pid_t child = fork();
+	assert(child >= 0);
+	if(child == 0) {
+		BuddyFileArena_t* arena = buddy_allocator_open_file(__test_path, __TEST_BAF_FILE_SIZE);
+		if(arena) {
+			__test_fill(arena);
+		}
+		raise(SIGKILL);
+	}
+
+	int status = 0;
+	assert(waitpid(child, &status, 0) == child);
+	assert(WIFSIGNALED(status));
+
+	BuddyFileArena_t* arena = buddy_allocator_open_file(__test_path, 0);
+	assert(arena);
+	__test_check_and_release(arena);
+	assert(buddy_file_arena_close(arena) == 0);
+
+	unlink(__test_path);
+}
+
+int main() {
+	TRACE_CALL;
+	snprintf(__test_path, sizeof(__test_path), "/tmp/test_buddy_allocator_file.%d", (int)getpid());
+
+	test_reopen();
+	test_exclusive_open();
+	test_recover_power_loss();
+	test_log_wrap();
+	test_large_file();
+	test_recover_killed();
+
+	assert(buddy_allocator_open_file(__test_path, 1) == NULL);
+	unlink(__test_path);
+
+	return 0;
+}
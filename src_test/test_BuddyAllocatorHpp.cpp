@@ -0,0 +1,164 @@
+#include "test_environment.h"
+#include "../src/BuddyAllocatorCompact.h"
+#include "../src/BuddyAllocatorFile.h"
+#include "../src/BuddyAllocatorNuma.h"
+#include "../src/BuddyAllocatorShared.h"
+#include "../src/BuddyAllocatorTrace.h"
+#include "../src/BuddyPool.h"
+#include "../src/BuddyAllocator.hpp"
+
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+#define __TEST_BAH_MEM_RANK (Rank_t)(__BUDDY_ALLOCATOR_RANK_MIN + 10)
+#define __TEST_BAH_MEM_CAPACITY (size_t)(1ull << __TEST_BAH_MEM_RANK)
+#define __TEST_BAH_ITEMS_NB (size_t)(1000)
+
+// Defined in test_BuddyAllocatorHpp_second.cpp, which includes the same headers.
+size_t __test_second_tu(buddy::Arena& arena);
+
+struct alignas(64) TestAligned_t {
+	uint8_t bytes[48];
+};
+
+static_assert(buddy::chunk_rank_v<1> == __BUDDY_ALLOCATOR_RANK_MIN);
+static_assert(buddy::chunk_rank_v<(1u << __BUDDY_ALLOCATOR_RANK_MIN) - sizeof(ChunkHdr_t)> == __BUDDY_ALLOCATOR_RANK_MIN);
+static_assert(buddy::chunk_rank_v<(1u << __BUDDY_ALLOCATOR_RANK_MIN)> == __BUDDY_ALLOCATOR_RANK_MIN + 1u);
+static_assert(buddy::chunk_rank_v<4000, 64> == __BUDDY_ALLOCATOR_RANK_MIN);
+static_assert(buddy::chunk_rank_v<4064, 64> == __BUDDY_ALLOCATOR_RANK_MIN + 1u);
+
+/**
+ * Checks the whole arena is free.
+ */
+void __test_all_free(buddy::Arena& arena) {
+	void* whole = arena.allocate(arena.capacity_max());
+	assert(whole);
+	arena.deallocate(whole);
+}
+
+void test_rank() {
+	TRACE_CALL;
+	for(size_t value = 0; value < (1ull << 20); value += 1u + value / 16u) {
+		assert(buddy::rank_of(value) == __buddy_allocator_rank(value));
+	}
+	assert(buddy::rank_of(SIZE_MAX) == __buddy_allocator_rank(SIZE_MAX));
+}
+
+void test_arena() {
+	TRACE_CALL;
+	buddy::Arena arena(__TEST_BAH_MEM_CAPACITY);
+	assert(arena.capacity_max() == __TEST_BAH_MEM_CAPACITY - sizeof(ChunkHdr_t));
+	assert((reinterpret_cast<uintptr_t>(arena.allocate(1)) & 4095u) == sizeof(ChunkHdr_t));
+	assert(arena.allocate(arena.capacity_max()) == nullptr);
+
+	bool thrown = false;
+	try {
+		buddy::Arena invalid(__TEST_BAH_MEM_CAPACITY + 1u);
+	} catch(const std::invalid_argument&) {
+		thrown = true;
+	}
+	assert(thrown);
+
+	// Borrowed memory.
+	void* mem = malloc(__TEST_BAH_MEM_CAPACITY);
+	assert(mem);
+	{
+		buddy::Arena borrowed(mem, __TEST_BAH_MEM_CAPACITY);
+		__test_all_free(borrowed);
+	}
+	free(mem);
+}
+
+void test_resource(buddy::Arena& arena) {
+	TRACE_CALL;
+	{
+		std::pmr::vector<size_t> vector(arena.resource());
+		std::pmr::unordered_map<size_t, size_t> map(arena.resource());
+		for(size_t i = 0; i < __TEST_BAH_ITEMS_NB; ++i) {
+			vector.push_back(i);
+		}
+		for(size_t i = 0; i < __TEST_BAH_ITEMS_NB / 10u; ++i) {
+			map[i] = i * i;
+		}
+		for(size_t i = 0; i < __TEST_BAH_ITEMS_NB; ++i) {
+			assert(vector[i] == i);
+		}
+		for(size_t i = 0; i < __TEST_BAH_ITEMS_NB / 10u; ++i) {
+			assert(map.at(i) == i * i);
+		}
+	}
+	__test_all_free(arena);
+
+	buddy::MemoryResource same(arena.native());
+	assert(arena.resource()->is_equal(same));
+	assert(!arena.resource()->is_equal(*std::pmr::new_delete_resource()));
+
+	// Over-aligned requests.
+	for(size_t align = 1; align <= 4096u; align <<= 1u) {
+		void* ptr = arena.resource()->allocate(100, align);
+		assert((reinterpret_cast<uintptr_t>(ptr) & (align - 1u)) == 0);
+		memset(ptr, 0xA5, 100);
+		arena.resource()->deallocate(ptr, 100, align);
+	}
+	__test_all_free(arena);
+
+	bool thrown = false;
+	try {
+		(void)arena.resource()->allocate(__TEST_BAH_MEM_CAPACITY);
+	} catch(const std::bad_alloc&) {
+		thrown = true;
+	}
+	assert(thrown);
+}
+
+void test_stl_allocator(buddy::Arena& arena) {
+	TRACE_CALL;
+	{
+		std::list<size_t, buddy::Allocator<size_t>> list{buddy::Allocator<size_t>(arena)};
+		for(size_t i = 0; i < 100u; ++i) {
+			list.push_back(i);
+		}
+		size_t expected = 0;
+		for(const size_t value : list) {
+			assert(value == expected++);
+		}
+
+		std::vector<TestAligned_t, buddy::Allocator<TestAligned_t>> aligned{buddy::Allocator<TestAligned_t>(arena)};
+		for(size_t i = 0; i < 100u; ++i) {
+			aligned.emplace_back();
+			assert((reinterpret_cast<uintptr_t>(aligned.data()) & 63u) == 0);
+		}
+
+		assert(buddy::Allocator<size_t>(arena) == buddy::Allocator<TestAligned_t>(arena));
+	}
+	__test_all_free(arena);
+
+	bool thrown = false;
+	try {
+		std::vector<uint8_t, buddy::Allocator<uint8_t>> huge(__TEST_BAH_MEM_CAPACITY, 0, buddy::Allocator<uint8_t>(arena));
+	} catch(const std::bad_alloc&) {
+		thrown = true;
+	}
+	assert(thrown);
+}
+
+void test_second_tu(buddy::Arena& arena) {
+	TRACE_CALL;
+	assert(__test_second_tu(arena) == __TEST_BAH_ITEMS_NB);
+	__test_all_free(arena);
+}
+
+int main() {
+	TRACE_CALL;
+
+	buddy::Arena arena(__TEST_BAH_MEM_CAPACITY);
+
+	test_rank();
+	test_arena();
+	test_resource(arena);
+	test_stl_allocator(arena);
+	test_second_tu(arena);
+
+	return 0;
+}
@@ -0,0 +1,21 @@
+#include "../src/BuddyAllocatorCompact.h"
+#include "../src/BuddyAllocatorFile.h"
+#include "../src/BuddyAllocatorNuma.h"
+#include "../src/BuddyAllocatorShared.h"
+#include "../src/BuddyAllocatorTrace.h"
+#include "../src/BuddyPool.h"
+#include "../src/BuddyAllocator.hpp"
+
+#include <vector>
+
+/**
+ * Used by test_BuddyAllocatorHpp.cpp, the headers are included by both translation units.
+ * @return the number of items stored in the arena.
+ */
+size_t __test_second_tu(buddy::Arena& arena) {
+	std::pmr::vector<size_t> vector(arena.resource());
+	for(size_t i = 0; i < 1000u; ++i) {
+		vector.push_back(i);
+	}
+	return vector.size();
+}
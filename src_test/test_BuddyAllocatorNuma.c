@@ -0,0 +1,244 @@
+#include "test_environment.h"
+#include "../src/BuddyAllocatorNuma.h"
+
+#define __TEST_BAN_NODES_NB (unsigned)(4)
+#define __TEST_BAN_NODE_RANK (Rank_t)(__BUDDY_ALLOCATOR_RANK_MIN + 4)
+#define __TEST_BAN_NODE_CAPACITY (size_t)(1ull << __TEST_BAN_NODE_RANK)
+#define __TEST_BAN_NODE_CHUNKS (size_t)(1ull << (__TEST_BAN_NODE_RANK - __BUDDY_ALLOCATOR_RANK_MIN))
+#define __TEST_BAN_WORKERS (unsigned)(8)
+#define __TEST_BAN_SLOTS (size_t)(8)
+#define __TEST_BAN_ITERATIONS (unsigned)(20000)
+
+// Per thread, so every worker runs on its own simulated node.
+static __thread NodeId_t __test_simulated_node = 0;
+
+NodeId_t __test_current_node(void* ctx) {
+	(void)ctx;
+	return __test_simulated_node;
+}
+
+BuddyNumaAllocator_t* __test_create_simulated(const BuddyNumaFallback_t fallback) {
+	BuddyNumaTopology_t topology;
+	memset(&topology, 0, sizeof(topology));
+	topology.nodes_nb = __TEST_BAN_NODES_NB;
+	topology.current_node = __test_current_node;
+	topology.bind = false;
+	return buddy_numa_allocator_create(&topology, __TEST_BAN_NODE_CAPACITY, fallback);
+}
+
+void test_local_node(BuddyNumaAllocator_t* ban) {
+	TRACE_CALL;
+	void* storage[__TEST_BAN_NODES_NB];
+
+	for(NodeId_t node = 0; node < __TEST_BAN_NODES_NB; ++node) {
+		__test_simulated_node = node;
+		storage[node] = buddy_numa_allocator_alloc(ban, 1);
+		assert(storage[node]);
+		assert(buddy_numa_allocator_node_of(ban, storage[node]) == node);
+	}
+
+	// Frees from a different node go back to the owning one.
+	__test_simulated_node = 0;
+	for(NodeId_t node = 0; node < __TEST_BAN_NODES_NB; ++node) {
+		buddy_numa_allocator_free(ban, storage[node]);
+	}
+
+	for(NodeId_t node = 0; node < __TEST_BAN_NODES_NB; ++node) {
+		void* whole = buddy_numa_allocator_alloc_on_node(ban, node, buddy_allocator_capacity_max(ban->nodes[node]));
+		assert(whole);
+		buddy_numa_allocator_free(ban, whole);
+	}
+}
+
+void test_fallback_none(BuddyNumaAllocator_t* ban) {
+	TRACE_CALL;
+	void* storage[__TEST_BAN_NODE_CHUNKS];
+
+	__test_simulated_node = 1;
+	for(size_t i = 0; i < __TEST_BAN_NODE_CHUNKS; ++i) {
+		storage[i] = buddy_numa_allocator_alloc(ban, 1);
+		assert(storage[i]);
+		assert(buddy_numa_allocator_node_of(ban, storage[i]) == 1);
+	}
+	assert(buddy_numa_allocator_alloc(ban, 1) == NULL);
+
+	for(size_t i = 0; i < __TEST_BAN_NODE_CHUNKS; ++i) {
+		buddy_numa_allocator_free(ban, storage[i]);
+	}
+}
+
+typedef struct {
+	BuddyNumaAllocator_t* ban;
+	void* cache[__TEST_BAN_NODE_CHUNKS];
+	size_t cache_nb;
+	size_t calls_nb;
+} TestPressureCtx_t;
+
+/**
+ * Releases one cached chunk through the NUMA allocator, which takes the node lock.
+ */
+void __test_pressure_release(void* raw_ctx, Rank_t rank) {
+	TestPressureCtx_t* const ctx = (TestPressureCtx_t*)raw_ctx;
+	(void)rank;
+	ctx->calls_nb++;
+	if(ctx->cache_nb) {
+		buddy_numa_allocator_free(ctx->ban, ctx->cache[--(ctx->cache_nb)]);
+	}
+}
+
+void test_pressure(BuddyNumaAllocator_t* ban) {
+	TRACE_CALL;
+	TestPressureCtx_t ctx;
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.ban = ban;
+	assert(buddy_numa_allocator_pressure_register(ban, 2, __test_pressure_release, &ctx) == 0);
+
+	__test_simulated_node = 2;
+	for(size_t i = 0; i < __TEST_BAN_NODE_CHUNKS; ++i) {
+		ctx.cache[ctx.cache_nb] = buddy_numa_allocator_alloc(ban, 1);
+		assert(ctx.cache[ctx.cache_nb]);
+		ctx.cache_nb++;
+	}
+	assert(ctx.calls_nb == 0);
+
+	// The node is full, the handler frees a chunk and the allocation is retried.
+	void* const retried = buddy_numa_allocator_alloc(ban, 1);
+	assert(retried);
+	assert(buddy_numa_allocator_node_of(ban, retried) == 2);
+	assert(ctx.calls_nb == 1);
+	assert(ctx.cache_nb == __TEST_BAN_NODE_CHUNKS - 1u);
+
+	// The watermark handlers run unlocked as well.
+	buddy_numa_allocator_free(ban, retried);
+	buddy_numa_allocator_set_watermark(ban, 2, __BUDDY_ALLOCATOR_RANK_MIN, 2);
+	void* const below = buddy_numa_allocator_alloc(ban, 1);
+	assert(below);
+	assert(ctx.calls_nb == 2);
+	buddy_numa_allocator_set_watermark(ban, 2, __BUDDY_ALLOCATOR_RANK_MIN, 0);
+	buddy_numa_allocator_free(ban, below);
+
+	buddy_numa_allocator_pressure_unregister(ban, 2, __test_pressure_release, &ctx);
+	while(ctx.cache_nb) {
+		buddy_numa_allocator_free(ban, ctx.cache[--(ctx.cache_nb)]);
+	}
+	void* whole = buddy_numa_allocator_alloc_on_node(ban, 2, buddy_allocator_capacity_max(ban->nodes[2]));
+	assert(whole);
+	buddy_numa_allocator_free(ban, whole);
+}
+
+void test_fallback_remote(BuddyNumaAllocator_t* ban) {
+	TRACE_CALL;
+	const size_t total_nb = __TEST_BAN_NODE_CHUNKS * __TEST_BAN_NODES_NB;
+	void* storage[total_nb];
+	size_t per_node[__TEST_BAN_NODES_NB] = {0};
+
+	__test_simulated_node = __TEST_BAN_NODES_NB - 1;
+	for(size_t i = 0; i < total_nb; ++i) {
+		storage[i] = buddy_numa_allocator_alloc(ban, 1);
+		assert(storage[i]);
+		const NodeId_t node = buddy_numa_allocator_node_of(ban, storage[i]);
+
+		// The local node is used up first, then the next ones in the round robin order.
+		assert(node == (__TEST_BAN_NODES_NB - 1 + i / __TEST_BAN_NODE_CHUNKS) % __TEST_BAN_NODES_NB);
+		per_node[node]++;
+	}
+	assert(buddy_numa_allocator_alloc(ban, 1) == NULL);
+
+	for(NodeId_t node = 0; node < __TEST_BAN_NODES_NB; ++node) {
+		assert(per_node[node] == __TEST_BAN_NODE_CHUNKS);
+	}
+
+	for(size_t i = 0; i < total_nb; ++i) {
+		buddy_numa_allocator_free(ban, storage[i]);
+	}
+}
+
+void* __test_worker(void* arg) {
+	BuddyNumaAllocator_t* const ban = (BuddyNumaAllocator_t*)arg;
+	static unsigned next_id = 0;
+	const unsigned worker_id = __atomic_fetch_add(&next_id, 1u, __ATOMIC_RELAXED);
+	uint8_t* storage[__TEST_BAN_SLOTS] = {0};
+	unsigned seed = worker_id;
+
+	__test_simulated_node = (NodeId_t)(worker_id % __TEST_BAN_NODES_NB);
+	for(unsigned i = 0; i < __TEST_BAN_ITERATIONS; ++i) {
+		const size_t slot = (size_t)rand_r(&seed) % __TEST_BAN_SLOTS;
+		if(storage[slot]) {
+			assert(storage[slot][0] == (uint8_t)(worker_id + slot));
+			buddy_numa_allocator_free(ban, storage[slot]);
+			storage[slot] = NULL;
+		} else {
+			storage[slot] = buddy_numa_allocator_alloc(ban, (size_t)rand_r(&seed) % (__TEST_BAN_NODE_CAPACITY >> 3) + 1u);
+			if(storage[slot]) {
+				storage[slot][0] = (uint8_t)(worker_id + slot);
+			}
+		}
+
+		// Move to another node now and then, so the frees cross the nodes.
+		if((i & 255u) == 0) {
+			__test_simulated_node = (NodeId_t)((__test_simulated_node + 1u) % __TEST_BAN_NODES_NB);
+		}
+	}
+
+	for(size_t slot = 0; slot < __TEST_BAN_SLOTS; ++slot) {
+		buddy_numa_allocator_free(ban, storage[slot]);
+	}
+	return NULL;
+}
+
+void test_multi_thread(BuddyNumaAllocator_t* ban) {
+	TRACE_CALL;
+	pthread_t workers[__TEST_BAN_WORKERS];
+
+	for(unsigned i = 0; i < __TEST_BAN_WORKERS; ++i) {
+		assert(pthread_create(&workers[i], NULL, __test_worker, ban) == 0);
+	}
+	for(unsigned i = 0; i < __TEST_BAN_WORKERS; ++i) {
+		assert(pthread_join(workers[i], NULL) == 0);
+	}
+
+	// All the chunks have been returned and coalesced on every node.
+	for(NodeId_t node = 0; node < __TEST_BAN_NODES_NB; ++node) {
+		void* whole = buddy_numa_allocator_alloc_on_node(ban, node, buddy_allocator_capacity_max(ban->nodes[node]));
+		assert(whole);
+		buddy_numa_allocator_free(ban, whole);
+	}
+}
+
+void test_system_topology() {
+	TRACE_CALL;
+	BuddyNumaTopology_t topology;
+	if(buddy_numa_topology_system(&topology) == 0) {
+		BuddyNumaAllocator_t* ban = buddy_numa_allocator_create(&topology, __TEST_BAN_NODE_CAPACITY, BUDDY_NUMA_FALLBACK_REMOTE);
+
+		// mbind(2) may be unavailable (no NUMA support in the kernel, sandboxing).
+		if(ban) {
+			uint8_t* raw = buddy_numa_allocator_alloc(ban, __TEST_BAN_NODE_CAPACITY >> 1);
+			assert(raw);
+			memset(raw, 0xA5, __TEST_BAN_NODE_CAPACITY >> 1);
+			buddy_numa_allocator_free(ban, raw);
+			buddy_numa_allocator_destroy(ban);
+		}
+	}
+}
+
+int main() {
+	TRACE_CALL;
+
+	BuddyNumaAllocator_t* ban = __test_create_simulated(BUDDY_NUMA_FALLBACK_NONE);
+	assert(ban);
+	test_local_node(ban);
+	test_fallback_none(ban);
+	test_pressure(ban);
+	buddy_numa_allocator_destroy(ban);
+
+	ban = __test_create_simulated(BUDDY_NUMA_FALLBACK_REMOTE);
+	assert(ban);
+	test_fallback_remote(ban);
+	test_multi_thread(ban);
+	buddy_numa_allocator_destroy(ban);
+
+	test_system_topology();
+
+	return 0;
+}
@@ -0,0 +1,182 @@
+#include "test_environment.h"
+#include "../src/BuddyAllocatorShared.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#define __TEST_BAS_SHM_SIZE (size_t)((1ull << (__BUDDY_ALLOCATOR_RANK_MIN + 8)) + 4096u)
+#define __TEST_BAS_WORKERS (unsigned)8
+#define __TEST_BAS_SLOTS (size_t)32
+#define __TEST_BAS_ITERATIONS (unsigned)20000
+#define __TEST_BAS_VERBOSE 0
+
+void test_integral(BuddySharedAllocator_t* bas) {
+	TRACE_CALL;
+	const size_t chunks_nb = 1ull << (bas->raw_memory_rank - __BUDDY_ALLOCATOR_RANK_MIN);
+	size_t* storage[chunks_nb];
+
+	for(size_t i = 0; i < chunks_nb; i++) {
+		storage[i] = buddy_shared_allocator_alloc(bas, sizeof(size_t));
+		assert(storage[i]);
+		*(storage[i]) = i;
+	}
+
+	for(size_t i = 0; i < chunks_nb; i++) {
+		assert(*(storage[i]) == i);
+		assert(buddy_shared_allocator_ptr(bas, buddy_shared_allocator_offset(bas, storage[i])) == storage[i]);
+	}
+
+	assert(buddy_shared_allocator_alloc(bas, 1) == NULL);
+
+	for(size_t i = 0; i < chunks_nb; i++) {
+		buddy_shared_allocator_free(bas, storage[i]);
+	}
+
+	void* whole = buddy_shared_allocator_alloc(bas, buddy_shared_allocator_capacity_max(bas));
+	assert(whole);
+	buddy_shared_allocator_free(bas, whole);
+}
+
+/**
+ * The top rank chunk lives in the last bucket.
+ * The region is reserved only, the pages touched are the chunk headers.
+ */
+void test_rank_max() {
+	TRACE_CALL;
+	const size_t shm_size = (size_t)((1ull << __BUDDY_ALLOCATOR_RANK_MAX) + 4096u);
+	void* const shm = mmap(NULL, shm_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	assert(shm != MAP_FAILED);
+
+	BuddySharedAllocator_t* bas = buddy_shared_allocator_create(shm, shm_size);
+	assert(bas);
+	assert(bas->raw_memory_rank == __BUDDY_ALLOCATOR_RANK_MAX);
+	assert(bas->buckets[__BUDDY_ALLOCATOR_RANK_RANGE] != __BUDDY_SHARED_ALLOCATOR_NIL);
+
+	void* small = buddy_shared_allocator_alloc(bas, 1);
+	assert(small);
+	assert(bas->buckets[__BUDDY_ALLOCATOR_RANK_RANGE] == __BUDDY_SHARED_ALLOCATOR_NIL);
+	buddy_shared_allocator_free(bas, small);
+	assert(bas->buckets[__BUDDY_ALLOCATOR_RANK_RANGE] == bas->raw_memory_off);
+
+	assert(buddy_shared_allocator_recover(bas) == 0);
+	assert(bas->buckets[__BUDDY_ALLOCATOR_RANK_RANGE] == bas->raw_memory_off);
+	for(Rank_t idx = 0; idx < __BUDDY_ALLOCATOR_RANK_RANGE; ++idx) {
+		assert(bas->buckets[idx] == __BUDDY_SHARED_ALLOCATOR_NIL);
+	}
+
+	void* whole = buddy_shared_allocator_alloc(bas, buddy_shared_allocator_capacity_max(bas));
+	assert(whole);
+	buddy_shared_allocator_free(bas, whole);
+
+	buddy_shared_allocator_destroy(bas);
+	munmap(shm, shm_size);
+}
+
+/**
+ * Every worker maps the segment once more, so its view of the allocator
+ * lives at a different address than the one the allocator was created at.
+ */
+int __test_worker(const int fd, const unsigned worker_id) {
+	void* const shm = mmap(NULL, __TEST_BAS_SHM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if(shm == MAP_FAILED) {
+		return 1;
+	}
+
+	BuddySharedAllocator_t* const bas = buddy_shared_allocator_attach(shm);
+	if(bas == NULL) {
+		return 2;
+	}
+
+	const size_t capacity_max = buddy_shared_allocator_capacity_max(bas);
+	uint8_t* storage[__TEST_BAS_SLOTS] = {0};
+	size_t sizes[__TEST_BAS_SLOTS] = {0};
+
+	srand(worker_id);
+	for(unsigned i = 0; i < __TEST_BAS_ITERATIONS; ++i) {
+		const size_t slot = (size_t)rand() % __TEST_BAS_SLOTS;
+		if(storage[slot]) {
+			for(size_t j = 0; j < sizes[slot]; ++j) {
+				if(storage[slot][j] != (uint8_t)(worker_id + slot + j)) {
+					return 3;
+				}
+			}
+			buddy_shared_allocator_free(bas, storage[slot]);
+			storage[slot] = NULL;
+		} else {
+			sizes[slot] = ((size_t)rand() % (capacity_max >> 4)) + 1u;
+			storage[slot] = buddy_shared_allocator_alloc(bas, sizes[slot]);
+			if(storage[slot]) {
+				for(size_t j = 0; j < sizes[slot]; ++j) {
+					storage[slot][j] = (uint8_t)(worker_id + slot + j);
+				}
+			}
+		}
+	}
+
+	for(size_t slot = 0; slot < __TEST_BAS_SLOTS; ++slot) {
+		buddy_shared_allocator_free(bas, storage[slot]);
+	}
+
+	munmap(shm, __TEST_BAS_SHM_SIZE);
+	return 0;
+}
+
+void test_multi_process(BuddySharedAllocator_t* bas, const int fd) {
+	TRACE_CALL;
+	pid_t workers[__TEST_BAS_WORKERS];
+
+	for(unsigned i = 0; i < __TEST_BAS_WORKERS; ++i) {
+		workers[i] = fork();
+		assert(workers[i] >= 0);
+		if(workers[i] == 0) {
+			_exit(__test_worker(fd, i));
+		}
+	}
+
+	for(unsigned i = 0; i < __TEST_BAS_WORKERS; ++i) {
+		int status = 0;
+		assert(waitpid(workers[i], &status, 0) == workers[i]);
+		assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+	}
+
+	// All the chunks have been returned and coalesced.
+	void* whole = buddy_shared_allocator_alloc(bas, buddy_shared_allocator_capacity_max(bas));
+	assert(whole);
+	buddy_shared_allocator_free(bas, whole);
+}
+
+int main() {
+	TRACE_CALL;
+
+	char name[64];
+	snprintf(name, sizeof(name), "/test_buddy_allocator_shared.%d", (int)getpid());
+
+	const int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+	assert(fd >= 0);
+	shm_unlink(name);
+	assert(ftruncate(fd, __TEST_BAS_SHM_SIZE) == 0);
+
+	void* const shm = mmap(NULL, __TEST_BAS_SHM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	assert(shm != MAP_FAILED);
+
+	assert(buddy_shared_allocator_attach(shm) == NULL);
+	BuddySharedAllocator_t* bas = buddy_shared_allocator_create(shm, __TEST_BAS_SHM_SIZE);
+	assert(bas);
+	assert(buddy_shared_allocator_attach(shm) == bas);
+
+	test_integral(bas);
+	test_multi_process(bas, fd);
+	test_rank_max();
+
+	if(__TEST_BAS_VERBOSE) {
+		__buddy_shared_allocator_dump(bas);
+	}
+
+	buddy_shared_allocator_destroy(bas);
+	munmap(shm, __TEST_BAS_SHM_SIZE);
+	close(fd);
+
+	return 0;
+}
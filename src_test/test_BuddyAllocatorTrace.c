@@ -0,0 +1,152 @@
+#include "test_environment.h"
+#include "../src/BuddyAllocator.h"
+
+#ifndef BUDDY_ALLOCATOR_TRACE
+#error "The test must be built with BUDDY_ALLOCATOR_TRACE defined."
+#endif
+
+#define __TEST_BAT_MEM_RANK_RANGE (Rank_t)(5)
+#define __TEST_BAT_MEM_RANK (Rank_t)(__TEST_BAT_MEM_RANK_RANGE + __BUDDY_ALLOCATOR_RANK_MIN)
+#define __TEST_BAT_MEM_CAPACITY (size_t)(1ull << __TEST_BAT_MEM_RANK)
+#define __TEST_BAT_ROUNDS (unsigned)(1000)
+#define __TEST_BAT_SECOND_ROUNDS (unsigned)(500)
+
+void __test_second_tu(BuddyAllocator_t* ba, unsigned rounds);
+
+/**
+ * Collects the records of the only ring from a dump.
+ */
+size_t __test_read_dump(BuddyTraceRecord_t* const records, const size_t records_max) {
+	FILE* const file = tmpfile();
+	assert(file);
+	assert(buddy_trace_dump(file) == 0);
+	rewind(file);
+
+	BuddyTraceFileHdr_t file_hdr;
+	assert(fread(&file_hdr, sizeof(file_hdr), 1, file) == 1);
+	assert(file_hdr.magic == __BUDDY_TRACE_MAGIC);
+	assert(file_hdr.version == __BUDDY_TRACE_VERSION);
+	assert(file_hdr.record_size == sizeof(BuddyTraceRecord_t));
+	assert(file_hdr.rings_nb == 1);
+
+	BuddyTraceRingHdr_t ring_hdr;
+	assert(fread(&ring_hdr, sizeof(ring_hdr), 1, file) == 1);
+	assert(ring_hdr.records_nb <= records_max);
+	assert(fread(records, sizeof(BuddyTraceRecord_t), ring_hdr.records_nb, file) == ring_hdr.records_nb);
+	fclose(file);
+	return ring_hdr.records_nb;
+}
+
+void test_records(BuddyAllocator_t* ba) {
+	TRACE_CALL;
+	BuddyTraceRecord_t records[8];
+
+	void* first = buddy_allocator_alloc(ba, 100);
+	void* second = buddy_allocator_alloc(ba, 1ull << __BUDDY_ALLOCATOR_RANK_MIN);
+	assert(first && second);
+	assert(buddy_allocator_alloc(ba, buddy_allocator_capacity_max(ba)) == NULL);
+	buddy_allocator_free(ba, second);
+	buddy_allocator_free(ba, first);
+
+	assert(__test_read_dump(records, 8) == 5);
+
+	// The whole arena is split down to the minimal rank.
+	assert(records[0].op == BUDDY_TRACE_OP_ALLOC);
+	assert(records[0].size == 100);
+	assert(records[0].rank == __BUDDY_ALLOCATOR_RANK_MIN);
+	assert(records[0].depth == __TEST_BAT_MEM_RANK_RANGE);
+
+	// One more split of the free buddy of rank + 1.
+	assert(records[1].op == BUDDY_TRACE_OP_ALLOC);
+	assert(records[1].rank == __BUDDY_ALLOCATOR_RANK_MIN + 1u);
+	assert(records[1].depth == 0);
+
+	assert(records[2].op == BUDDY_TRACE_OP_ALLOC_FAILED);
+	assert(records[2].rank == __TEST_BAT_MEM_RANK);
+
+	assert(records[3].op == BUDDY_TRACE_OP_FREE);
+	assert(records[3].rank == __BUDDY_ALLOCATOR_RANK_MIN + 1u);
+	assert(records[3].depth == 0);
+
+	// Merges all the way up.
+	assert(records[4].op == BUDDY_TRACE_OP_FREE);
+	assert(records[4].rank == __BUDDY_ALLOCATOR_RANK_MIN);
+	assert(records[4].depth == __TEST_BAT_MEM_RANK_RANGE);
+
+	for(size_t i = 1; i < 5; ++i) {
+		assert(records[i].timestamp >= records[i - 1].timestamp);
+	}
+}
+
+void test_histogram(BuddyAllocator_t* ba) {
+	TRACE_CALL;
+	uint64_t histogram[__BUDDY_TRACE_HIST_SIZE];
+	const uint64_t before = buddy_trace_histogram(__BUDDY_ALLOCATOR_RANK_MIN, histogram);
+
+	for(unsigned i = 0; i < __TEST_BAT_ROUNDS; ++i) {
+		buddy_allocator_free(ba, buddy_allocator_alloc(ba, 1));
+	}
+
+	assert(buddy_trace_histogram(__BUDDY_ALLOCATOR_RANK_MIN, histogram) == before + 2u * __TEST_BAT_ROUNDS);
+
+	const uint64_t p50 = buddy_trace_percentile(__BUDDY_ALLOCATOR_RANK_MIN, 50.0);
+	const uint64_t p99 = buddy_trace_percentile(__BUDDY_ALLOCATOR_RANK_MIN, 99.0);
+	assert(p50 > 0);
+	assert(p99 >= p50);
+	assert(buddy_trace_percentile(__BUDDY_ALLOCATOR_RANK_MAX, 50.0) == 0);
+
+	// The ring keeps the latest records only.
+	BuddyTraceRecord_t* const records = malloc(sizeof(BuddyTraceRecord_t) * __BUDDY_TRACE_RING_SIZE);
+	assert(records);
+	assert(__test_read_dump(records, __BUDDY_TRACE_RING_SIZE) == 5u + 2u * __TEST_BAT_ROUNDS);
+	free(records);
+}
+
+/**
+ * The records made from another translation unit land in the same ring.
+ */
+void test_two_units(BuddyAllocator_t* ba) {
+	TRACE_CALL;
+	uint64_t histogram[__BUDDY_TRACE_HIST_SIZE];
+	const uint64_t before = buddy_trace_histogram(__BUDDY_ALLOCATOR_RANK_MIN, histogram);
+
+	__test_second_tu(ba, __TEST_BAT_SECOND_ROUNDS);
+
+	assert(buddy_trace_histogram(__BUDDY_ALLOCATOR_RANK_MIN, histogram) == before + 2u * __TEST_BAT_SECOND_ROUNDS);
+
+	BuddyTraceRecord_t* const records = malloc(sizeof(BuddyTraceRecord_t) * __BUDDY_TRACE_RING_SIZE);
+	assert(records);
+	assert(__test_read_dump(records, __BUDDY_TRACE_RING_SIZE) == 5u + 2u * (__TEST_BAT_ROUNDS + __TEST_BAT_SECOND_ROUNDS));
+	free(records);
+}
+
+void test_hist_buckets() {
+	TRACE_CALL;
+	for(uint64_t value = 0; value < (1ull << 20); value += 1u + value / 64u) {
+		const unsigned bucket = __buddy_trace_hist_bucket(value);
+		assert(bucket < __BUDDY_TRACE_HIST_SIZE);
+		assert(__buddy_trace_hist_value(bucket) <= value);
+		assert(__buddy_trace_hist_value(bucket + 1u) > value);
+	}
+	assert(__buddy_trace_hist_bucket(UINT64_MAX) < __BUDDY_TRACE_HIST_SIZE);
+}
+
+int main() {
+	TRACE_CALL;
+
+	void* mem = malloc(__TEST_BAT_MEM_CAPACITY);
+	assert(mem);
+
+	BuddyAllocator_t* ba = buddy_allocator_create(mem, __TEST_BAT_MEM_CAPACITY);
+	assert(ba);
+
+	test_records(ba);
+	test_histogram(ba);
+	test_two_units(ba);
+	test_hist_buckets();
+
+	buddy_allocator_destroy(ba);
+	free(mem);
+
+	return 0;
+}
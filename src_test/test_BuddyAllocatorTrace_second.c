@@ -0,0 +1,10 @@
+#include "../src/BuddyAllocator.h"
+
+/**
+ * Used by test_BuddyAllocatorTrace.c, the trace state is defined by both translation units.
+ */
+void __test_second_tu(BuddyAllocator_t* ba, const unsigned rounds) {
+	for(unsigned i = 0; i < rounds; ++i) {
+		buddy_allocator_free(ba, buddy_allocator_alloc(ba, 1));
+	}
+}
@@ -0,0 +1,174 @@
+#include "test_environment.h"
+#include "../src/BuddyAllocatorWalk.h"
+
+#define __TEST_BAW_MEM_RANK_RANGE (Rank_t)(6)
+#define __TEST_BAW_MEM_RANK (Rank_t)(__TEST_BAW_MEM_RANK_RANGE + __BUDDY_ALLOCATOR_RANK_MIN)
+#define __TEST_BAW_MEM_CAPACITY (size_t)(1ull << __TEST_BAW_MEM_RANK)
+#define __TEST_BAW_STORAGE_SIZE (size_t)(1ull << __TEST_BAW_MEM_RANK_RANGE)
+#define __TEST_BAW_VERBOSE 0
+
+typedef struct {
+	BuddyWalkChunk_t chunks[__TEST_BAW_STORAGE_SIZE];
+	size_t chunks_nb;
+	size_t next_offset;
+} TestWalkCtx_t;
+
+bool __test_collect(void* raw_ctx, const BuddyWalkChunk_t* chunk) {
+	TestWalkCtx_t* const ctx = (TestWalkCtx_t*)raw_ctx;
+	assert(chunk->offset == ctx->next_offset);
+	assert(chunk->rank >= __BUDDY_ALLOCATOR_RANK_MIN && chunk->rank <= __TEST_BAW_MEM_RANK);
+	ctx->chunks[ctx->chunks_nb++] = *chunk;
+	ctx->next_offset += 1ull << chunk->rank;
+	return true;
+}
+
+bool __test_stop(void* raw_ctx, const BuddyWalkChunk_t* chunk) {
+	size_t* const visited = (size_t*)raw_ctx;
+	(*visited)++;
+	return false;
+}
+
+/**
+ * Allocates chunks of various ranks, every third one is freed.
+ */
+size_t __test_fragment(BuddyAllocator_t* ba, void** storage) {
+	size_t result = 0;
+	for(size_t i = 0; i < __TEST_BAW_STORAGE_SIZE; ++i) {
+		const size_t size = (1ull << (__BUDDY_ALLOCATOR_RANK_MIN + i % 3u)) - sizeof(ChunkHdr_t);
+		storage[i] = buddy_allocator_alloc(ba, size);
+	}
+	for(size_t i = 0; i < __TEST_BAW_STORAGE_SIZE; i += 3u) {
+		buddy_allocator_free(ba, storage[i]);
+		storage[i] = NULL;
+	}
+	for(size_t i = 0; i < __TEST_BAW_STORAGE_SIZE; ++i) {
+		result += storage[i] ? 1u : 0;
+	}
+	return result;
+}
+
+void test_walk(BuddyAllocator_t* ba) {
+	TRACE_CALL;
+	void* storage[__TEST_BAW_STORAGE_SIZE];
+	const size_t live_nb = __test_fragment(ba, storage);
+
+	TestWalkCtx_t ctx;
+	memset(&ctx, 0, sizeof(ctx));
+	assert(buddy_allocator_walk(ba, __test_collect, &ctx) == ctx.chunks_nb);
+	assert(ctx.next_offset == __TEST_BAW_MEM_CAPACITY);
+
+	size_t busy_nb = 0;
+	for(size_t i = 0; i < ctx.chunks_nb; ++i) {
+		if(ctx.chunks[i].busy) {
+			busy_nb++;
+		}
+	}
+	assert(busy_nb == live_nb);
+
+	// Locate every minimal chunk offset.
+	size_t chunk_idx = 0;
+	for(size_t offset = 0; offset < __TEST_BAW_MEM_CAPACITY; offset += 1ull << __BUDDY_ALLOCATOR_RANK_MIN) {
+		if(offset >= ctx.chunks[chunk_idx].offset + (1ull << ctx.chunks[chunk_idx].rank)) {
+			chunk_idx++;
+		}
+		assert(__buddy_allocator_walk_locate(ba, offset) == ctx.chunks[chunk_idx].offset);
+	}
+
+	size_t visited = 0;
+	assert(buddy_allocator_walk(ba, __test_stop, &visited) == 1);
+	assert(visited == 1);
+
+	for(size_t i = 0; i < __TEST_BAW_STORAGE_SIZE; ++i) {
+		buddy_allocator_free(ba, storage[i]);
+	}
+}
+
+void test_report(BuddyAllocator_t* ba) {
+	TRACE_CALL;
+	void* storage[__TEST_BAW_STORAGE_SIZE];
+	__test_fragment(ba, storage);
+
+	BuddyWalkReport_t full;
+	BuddyWalkCursor_t cursor;
+	buddy_allocator_report_begin(&full);
+	buddy_allocator_walk_begin(&cursor);
+	assert(buddy_allocator_report_step(ba, &cursor, SIZE_MAX, &full));
+	assert(full.busy_bytes + full.free_bytes == __TEST_BAW_MEM_CAPACITY);
+
+	size_t live_bytes = 0;
+	for(size_t i = 0; i < __TEST_BAW_STORAGE_SIZE; ++i) {
+		if(storage[i]) {
+			live_bytes += 1ull << __buddy_allocator_header_ptr(storage[i])->rank;
+		}
+	}
+	assert(full.busy_bytes == live_bytes);
+
+	// The same report chunk by chunk.
+	BuddyWalkReport_t chunked;
+	buddy_allocator_report_begin(&chunked);
+	buddy_allocator_walk_begin(&cursor);
+	size_t steps = 0;
+	while(!buddy_allocator_report_step(ba, &cursor, 1, &chunked)) {
+		steps++;
+	}
+	assert(steps + 1u == full.chunks_nb);
+	assert(memcmp(&full, &chunked, sizeof(full)) == 0);
+
+	if(__TEST_BAW_VERBOSE) {
+		buddy_allocator_report_print(&full, stdout);
+	}
+
+	for(size_t i = 0; i < __TEST_BAW_STORAGE_SIZE; ++i) {
+		buddy_allocator_free(ba, storage[i]);
+	}
+}
+
+void test_walk_concurrent_changes(BuddyAllocator_t* ba) {
+	TRACE_CALL;
+	void* storage[__TEST_BAW_STORAGE_SIZE];
+	__test_fragment(ba, storage);
+
+	// The allocator is changed between every two steps.
+	BuddyWalkReport_t report;
+	BuddyWalkCursor_t cursor;
+	buddy_allocator_report_begin(&report);
+	buddy_allocator_walk_begin(&cursor);
+	size_t idx = 0;
+	while(!buddy_allocator_report_step(ba, &cursor, 1, &report)) {
+		if(idx < __TEST_BAW_STORAGE_SIZE) {
+			buddy_allocator_free(ba, storage[idx]);
+			storage[idx++] = NULL;
+		}
+	}
+	assert(report.busy_bytes + report.free_bytes <= __TEST_BAW_MEM_CAPACITY);
+
+	for(size_t i = 0; i < __TEST_BAW_STORAGE_SIZE; ++i) {
+		buddy_allocator_free(ba, storage[i]);
+	}
+
+	// Everything is merged back.
+	buddy_allocator_report_begin(&report);
+	buddy_allocator_walk_begin(&cursor);
+	assert(buddy_allocator_report_step(ba, &cursor, SIZE_MAX, &report));
+	assert(report.chunks_nb == 1);
+	assert(report.free_nb[__TEST_BAW_MEM_RANK_RANGE] == 1);
+}
+
+int main() {
+	TRACE_CALL;
+
+	void* mem = malloc(__TEST_BAW_MEM_CAPACITY);
+	assert(mem);
+
+	BuddyAllocator_t* ba = buddy_allocator_create(mem, __TEST_BAW_MEM_CAPACITY);
+	assert(ba);
+
+	test_walk(ba);
+	test_report(ba);
+	test_walk_concurrent_changes(ba);
+
+	buddy_allocator_destroy(ba);
+	free(mem);
+
+	return 0;
+}
@@ -0,0 +1,125 @@
+#include "test_environment.h"
+#include "../src/BuddyPool.h"
+
+#define __TEST_BP_MEM_RANK (Rank_t)(__BUDDY_ALLOCATOR_RANK_MIN + 8)
+#define __TEST_BP_MEM_CAPACITY (size_t)(1ull << __TEST_BP_MEM_RANK)
+#define __TEST_BP_STORAGE_SIZE (size_t)(4096)
+#define __TEST_BP_VERBOSE 0
+
+typedef struct {
+	uint64_t id;
+	uint32_t flags;
+	uint8_t payload[44];
+} TestSession_t;
+
+typedef struct {
+	uint8_t bytes[48];
+} __attribute__((aligned(64))) TestAligned_t;
+
+void test_get_put(BuddyAllocator_t* ba) {
+	TRACE_CALL;
+	BuddyPool_t* pool = buddy_pool_create_typed(ba, TestSession_t);
+	assert(pool);
+	assert(pool->slots_nb >= __BUDDY_POOL_SLAB_SLOTS_MIN);
+
+	TestSession_t* storage[__TEST_BP_STORAGE_SIZE];
+	for(size_t i = 0; i < __TEST_BP_STORAGE_SIZE; ++i) {
+		storage[i] = buddy_pool_get(pool);
+		assert(storage[i]);
+		storage[i]->id = i;
+		memset(storage[i]->payload, (int)i, sizeof(storage[i]->payload));
+	}
+	assert(pool->slabs_nb == (__TEST_BP_STORAGE_SIZE + pool->slots_nb - 1u) / pool->slots_nb);
+
+	for(size_t i = 0; i < __TEST_BP_STORAGE_SIZE; ++i) {
+		assert(storage[i]->id == i);
+		for(size_t j = 0; j < sizeof(storage[i]->payload); ++j) {
+			assert(storage[i]->payload[j] == (uint8_t)i);
+		}
+	}
+
+	// Reuse: a put slot is the next one to get.
+	buddy_pool_put(pool, storage[7]);
+	assert(buddy_pool_get(pool) == storage[7]);
+
+	for(size_t i = 0; i < __TEST_BP_STORAGE_SIZE; ++i) {
+		buddy_pool_put(pool, storage[i]);
+	}
+
+	// The pool shrinks down to a single cached slab.
+	assert(pool->slabs_nb == 1);
+	assert(pool->full == NULL);
+
+	buddy_pool_shrink(pool);
+	assert(pool->slabs_nb == 0);
+
+	void* whole = buddy_allocator_alloc(ba, buddy_allocator_capacity_max(ba));
+	assert(whole);
+	buddy_allocator_free(ba, whole);
+
+	buddy_pool_destroy(pool);
+}
+
+void test_align(BuddyAllocator_t* ba) {
+	TRACE_CALL;
+	BuddyPool_t* pool = buddy_pool_create_typed(ba, TestAligned_t);
+	assert(pool);
+	assert(pool->obj_size == 64);
+
+	TestAligned_t* storage[__TEST_BP_STORAGE_SIZE / 4];
+	for(size_t i = 0; i < __TEST_BP_STORAGE_SIZE / 4; ++i) {
+		storage[i] = buddy_pool_get(pool);
+		assert(storage[i]);
+		assert(((uintptr_t)storage[i] & 63u) == 0);
+	}
+
+	buddy_pool_destroy(pool);
+
+	void* whole = buddy_allocator_alloc(ba, buddy_allocator_capacity_max(ba));
+	assert(whole);
+	buddy_allocator_free(ba, whole);
+}
+
+void test_exhaustion(BuddyAllocator_t* ba) {
+	TRACE_CALL;
+	const size_t obj_size = buddy_allocator_capacity_max(ba) / 3;
+	BuddyPool_t* pool = buddy_pool_create(ba, obj_size, 8);
+	assert(pool);
+	assert(pool->slots_nb == 2);
+
+	void* first = buddy_pool_get(pool);
+	void* second = buddy_pool_get(pool);
+	assert(first && second);
+	assert(buddy_pool_get(pool) == NULL);
+
+	buddy_pool_put(pool, second);
+	buddy_pool_put(pool, first);
+	buddy_pool_destroy(pool);
+
+	assert(buddy_pool_create(ba, buddy_allocator_capacity_max(ba), 8) == NULL);
+	assert(buddy_pool_create(ba, 0, 8) == NULL);
+	assert(buddy_pool_create(ba, 8, 3) == NULL);
+}
+
+int main() {
+	TRACE_CALL;
+
+	void* mem = malloc(__TEST_BP_MEM_CAPACITY);
+	assert(mem);
+
+	BuddyAllocator_t* ba = buddy_allocator_create(mem, __TEST_BP_MEM_CAPACITY);
+	assert(ba);
+
+	test_get_put(ba);
+	test_align(ba);
+	test_exhaustion(ba);
+
+	if(__TEST_BP_VERBOSE) {
+		__buddy_allocator_dump(ba);
+	}
+
+	buddy_allocator_destroy(ba);
+	free(mem);
+
+	return 0;
+}
@@ -0,0 +1,218 @@
+#include "test_environment.h"
+
+#include <stdint.h>
+
+struct DummyNode1;
+struct DummyNode1 {
+	struct DummyNode1* prev;
+	struct DummyNode1* next;
+	uint64_t user_data;
+};
+
+typedef struct DummyNode1 CDListNode_t;
+
+#include "../src/CDList.h"
+
+void test_cdlist_dump(CDList_t* const ins);
+
+void test_cdlist_push_back_pop_back(
+	CDList_t* const list,
+	CDListNode_t* const storage,
+	const size_t storage_nb
+                                   ) {
+	TRACE_CALL;
+	assert(cdlist_empty(list));
+	assert(cdlist_pop_back(list) == NULL);
+	for(size_t i = 0; i < storage_nb; ++i) {
+		CDListNode_t* node_push = storage + i;
+		cdlist_push_back(list, node_push);
+		assert(!cdlist_empty(list));
+		assert(cdlist_pop_back(list) == node_push);
+	}
+	assert(cdlist_size(list) == 0);
+
+	for(size_t i = 0; i < storage_nb; ++i) {
+		cdlist_push_back(list, storage + i);
+	}
+	assert(cdlist_size(list) == storage_nb);
+
+	for(size_t i = storage_nb - 1; i < storage_nb; --i) {
+		assert(cdlist_pop_back(list) == storage + i);
+	}
+	assert(cdlist_empty(list));
+}
+
+void test_cdlist_push_back_pop_front(
+	CDList_t* const list,
+	CDListNode_t* const storage,
+	const size_t storage_nb
+                                    ) {
+	TRACE_CALL;
+	assert(cdlist_empty(list));
+	assert(cdlist_pop_front(list) == NULL);
+	for(size_t i = 0; i < storage_nb; ++i) {
+		CDListNode_t* node_push = storage + i;
+		cdlist_push_back(list, node_push);
+		assert(cdlist_pop_front(list) == node_push);
+	}
+	assert(cdlist_size(list) == 0);
+
+	for(size_t i = 0; i < storage_nb; ++i) {
+		cdlist_push_back(list, storage + i);
+	}
+	assert(cdlist_size(list) == storage_nb);
+
+	for(size_t i = 0; i < storage_nb; ++i) {
+		assert(cdlist_pop_front(list) == storage + i);
+	}
+	assert(cdlist_empty(list));
+}
+
+void test_cdlist_push_front_pop_back(
+	CDList_t* const list,
+	CDListNode_t* const storage,
+	const size_t storage_nb
+                                    ) {
+	TRACE_CALL;
+	assert(cdlist_empty(list));
+	for(size_t i = 0; i < storage_nb; ++i) {
+		CDListNode_t* node_push = storage + i;
+		cdlist_push_front(list, node_push);
+		assert(cdlist_pop_back(list) == node_push);
+	}
+	assert(cdlist_size(list) == 0);
+
+	for(size_t i = 0; i < storage_nb; ++i) {
+		cdlist_push_front(list, storage + i);
+	}
+	assert(cdlist_size(list) == storage_nb);
+
+	for(size_t i = 0; i < storage_nb; ++i) {
+		assert(cdlist_pop_back(list) == storage + i);
+	}
+	assert(cdlist_empty(list));
+}
+
+void test_cdlist_push_front_pop_front(
+	CDList_t* const list,
+	CDListNode_t* const storage,
+	const size_t storage_nb
+                                     ) {
+	TRACE_CALL;
+	assert(cdlist_empty(list));
+	for(size_t i = 0; i < storage_nb; ++i) {
+		CDListNode_t* node_push = storage + i;
+		cdlist_push_front(list, node_push);
+		assert(cdlist_pop_front(list) == node_push);
+	}
+	assert(cdlist_size(list) == 0);
+
+	for(size_t i = 0; i < storage_nb; ++i) {
+		cdlist_push_front(list, storage + i);
+	}
+	assert(cdlist_size(list) == storage_nb);
+
+	for(size_t i = storage_nb - 1; i < storage_nb; --i) {
+		assert(cdlist_pop_front(list) == storage + i);
+	}
+	assert(cdlist_empty(list));
+}
+
+void test_cdlist_push_before_after(
+	CDList_t* const list,
+	CDListNode_t* const storage,
+	const size_t storage_nb
+                                  ) {
+	TRACE_CALL;
+	assert(cdlist_empty(list));
+	CDListNode_t* node_base = storage + 0;
+	cdlist_push_front(list, node_base);
+
+	// 1 2 .. base .. N-2 N-1
+	for(size_t i = 1; i < storage_nb; ++i) {
+		if(i % 2u) {
+			cdlist_push_before(node_base, storage + i);
+		} else {
+			cdlist_push_after(node_base, storage + i);
+		}
+	}
+	assert(cdlist_size(list) == storage_nb);
+	assert(cdlist_end(list)->next == storage + 1);
+	assert(cdlist_end(list)->prev == storage + 2);
+
+	cdlist_remove(node_base);
+	assert(cdlist_size(list) == storage_nb - 1);
+
+	size_t odd_nb = 0;
+	for(CDListNode_t* node = cdlist_end(list)->next; node != cdlist_end(list); node = node->next) {
+		assert(node->next->prev == node);
+		assert(node->prev->next == node);
+		odd_nb += (size_t)(node - storage) % 2u;
+	}
+	assert(odd_nb == storage_nb / 2u);
+
+	cdlist_reset(list);
+	assert(cdlist_empty(list));
+}
+
+void test_cdlist_remove(
+	CDList_t* const list,
+	CDListNode_t* const storage,
+	const size_t storage_nb
+                       ) {
+	TRACE_CALL;
+	assert(cdlist_empty(list));
+	for(size_t i = 0; i < storage_nb; ++i) {
+		cdlist_push_front(list, storage + i);
+		cdlist_remove(storage + i);
+	}
+	assert(cdlist_empty(list));
+
+	for(size_t i = 0; i < storage_nb; ++i) {
+		storage[i].user_data = i;
+		cdlist_push_front(list, storage + i);
+	}
+
+	// The head, the tail and a middle node need no special care.
+	cdlist_remove(storage + storage_nb - 1u);
+	cdlist_remove(storage + 0);
+	cdlist_remove(storage + storage_nb / 2u);
+	assert(cdlist_size(list) == storage_nb - 3u);
+
+	if(0) {
+		test_cdlist_dump(list);
+	}
+
+	for(size_t i = 1; i < storage_nb - 1u; ++i) {
+		if(i != storage_nb / 2u) {
+			cdlist_remove(storage + i);
+		}
+	}
+	assert(cdlist_empty(list));
+	assert(cdlist_size(list) == 0);
+}
+
+void test_cdlist_dump(CDList_t* const ins) {
+	printf("<CDList> has %zu elements \n", cdlist_size(ins));
+	for(CDListNode_t* node = cdlist_end(ins)->next; node != cdlist_end(ins); node = node->next) {
+		printf(" -> [%zu]", node->user_data);
+	}
+	printf("\n");
+}
+
+
+int main() {
+	TRACE_CALL;
+	static const unsigned STORAGE_SIZE = 16;
+	CDListNode_t storage[STORAGE_SIZE];
+	CDList_t list;
+
+	cdlist_init(&list);
+	test_cdlist_push_back_pop_back(&list, storage, STORAGE_SIZE);
+	test_cdlist_push_back_pop_front(&list, storage, STORAGE_SIZE);
+	test_cdlist_push_front_pop_back(&list, storage, STORAGE_SIZE);
+	test_cdlist_push_front_pop_front(&list, storage, STORAGE_SIZE);
+	test_cdlist_push_before_after(&list, storage, STORAGE_SIZE);
+	test_cdlist_remove(&list, storage, STORAGE_SIZE);
+	return EXIT_SUCCESS;
+}